@@ -3,11 +3,14 @@ varying highp vec2 qt_TexCoord;
 uniform sampler2D qt_Texture;
 uniform lowp float opacity;
 uniform bool invert;
+uniform bool luminance; // single channel texture, gray level in .r
 
 void main()
 {
     vec4 fragColor = texture2D(qt_Texture, qt_TexCoord) ; //* opacity;
 //    fragColor.g = 0.5;
+    if (luminance)
+        fragColor = vec4(fragColor.rrr, 1.0);
 
     if (invert) {
 //        gl_FragColor = mix(vec4(vec3(1,1,1) - fragColor.rgb, fragColor.a),
@@ -0,0 +1,184 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "benchcorpus.h"
+#include <QPdfWriter>
+#include <QPainter>
+#include <QPainterPath>
+#include <QPageSize>
+#include <QRandomGenerator>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QImage>
+#include <QStringList>
+#include <QtMath>
+
+namespace {
+// Always the same corpus, so that runs on different builds are comparable
+constexpr quint32 kSeed = 0x9df;
+constexpr int kResolution = 300; // dpi of the painter coordinates
+
+QString words(QRandomGenerator &rng, int count)
+{
+    static const QStringList dictionary = QStringLiteral(
+        "lorem ipsum dolor sit amet consectetur adipiscing elit sed do eiusmod tempor "
+        "incididunt ut labore et dolore magna aliqua enim ad minim veniam quis nostrud "
+        "exercitation ullamco laboris nisi aliquip ex ea commodo consequat duis aute irure "
+        "in reprehenderit voluptate velit esse cillum fugiat nulla pariatur excepteur sint "
+        "occaecat cupidatat non proident sunt culpa qui officia deserunt mollit anim id est "
+        "laborum").split(QLatin1Char(' '));
+    QStringList res;
+    res.reserve(count);
+    for (int i = 0; i < count; ++i)
+        res.append(dictionary.at(rng.bounded(dictionary.size())));
+    return res.join(QLatin1Char(' '));
+}
+
+void paintText(QPainter &p, const QRect &page, QRandomGenerator &rng)
+{
+    static const char *families[] = { "Serif", "Sans", "Monospace" };
+    const int columnWidth = (page.width() - 100) / 2;
+    for (int column = 0; column < 2; ++column) {
+        QRect r(page.x() + column * (columnWidth + 100), page.y(), columnWidth, page.height());
+        while (r.height() > 0) {
+            QFont f(QLatin1String(families[rng.bounded(3)]));
+            f.setPointSizeF(8 + rng.bounded(5));
+            f.setItalic(rng.bounded(8) == 0);
+            p.setFont(f);
+            const QString paragraph = words(rng, 40 + rng.bounded(80));
+            QRect bounding;
+            p.drawText(r, Qt::TextWordWrap | Qt::AlignJustify, paragraph, &bounding);
+            r.setTop(bounding.bottom() + 30);
+        }
+    }
+}
+
+void paintVector(QPainter &p, const QRect &page, QRandomGenerator &rng)
+{
+    p.setRenderHint(QPainter::Antialiasing);
+    for (int i = 0; i < 3000; ++i) {
+        QPainterPath path;
+        path.moveTo(page.x() + rng.bounded(page.width()), page.y() + rng.bounded(page.height()));
+        for (int s = 0; s < 4; ++s) {
+            path.cubicTo(page.x() + rng.bounded(page.width()), page.y() + rng.bounded(page.height()),
+                         page.x() + rng.bounded(page.width()), page.y() + rng.bounded(page.height()),
+                         page.x() + rng.bounded(page.width()), page.y() + rng.bounded(page.height()));
+        }
+        const QColor c = QColor::fromRgb(rng.generate());
+        p.setPen(QPen(c, 1 + rng.bounded(6)));
+        if (i % 4 == 0) {
+            path.closeSubpath();
+            p.setBrush(QColor(c.red(), c.green(), c.blue(), 64));
+        } else {
+            p.setBrush(Qt::NoBrush);
+        }
+        p.drawPath(path);
+    }
+}
+
+QImage photo(QRandomGenerator &rng, const QSize &size)
+{
+    // Smooth gradients plus noise: compresses about as badly as a photograph
+    QImage img(size, QImage::Format_RGB32);
+    const int phase = rng.bounded(256);
+    for (int y = 0; y < size.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(img.scanLine(y));
+        for (int x = 0; x < size.width(); ++x) {
+            const int n = rng.bounded(48);
+            line[x] = qRgb((x + phase + n) & 0xff,
+                           (y + n) & 0xff,
+                           ((x ^ y) + phase) & 0xff);
+        }
+    }
+    return img;
+}
+
+void paintImage(QPainter &p, const QRect &page, QRandomGenerator &rng)
+{
+    const int w = page.width() / 2;
+    const int h = page.height() / 2;
+    for (int i = 0; i < 4; ++i) {
+        const QRect target(page.x() + (i % 2) * w, page.y() + (i / 2) * h, w, h);
+        p.drawImage(target, photo(rng, QSize(1024, 1024)));
+    }
+}
+
+void paintLong(QPainter &p, const QRect &page, QRandomGenerator &rng, int pageNumber)
+{
+    QFont f(QStringLiteral("Serif"));
+    f.setPointSize(24);
+    p.setFont(f);
+    p.drawText(page.topLeft() + QPoint(0, 120), QStringLiteral("Page %1").arg(pageNumber + 1));
+    f.setPointSize(10);
+    p.setFont(f);
+    p.drawText(page.adjusted(0, 200, 0, 0), Qt::TextWordWrap, words(rng, 120));
+}
+} // namespace
+
+QVector<BenchDocument> BenchCorpus::generate(const QString &directory, int longPageCount)
+{
+    QVector<BenchDocument> res;
+    res << generate(Text, directory, 50)
+        << generate(Vector, directory, 20)
+        << generate(Image, directory, 20)
+        << generate(Long, directory, longPageCount);
+    return res;
+}
+
+BenchDocument BenchCorpus::generate(Kind kind, const QString &directory, int pageCount)
+{
+    static const char *names[] = { "text", "vector", "image", "long" };
+    BenchDocument doc;
+    doc.name = QLatin1String(names[kind]);
+    doc.pageCount = pageCount;
+    doc.path = QDir(directory).absoluteFilePath(doc.name + QLatin1Char('-')
+                                                + QString::number(pageCount)
+                                                + QStringLiteral(".pdf"));
+    if (QFileInfo::exists(doc.path))
+        return doc;
+
+    QDir().mkpath(directory);
+    // Never leave a truncated document behind, it would be reused
+    const QString partial = doc.path + QStringLiteral(".part");
+    QFile::remove(partial);
+    QPdfWriter writer(partial);
+    writer.setPageSize(QPageSize(QPageSize::A4));
+    writer.setResolution(kResolution);
+    writer.setCreator(QStringLiteral("qdf-bench"));
+    QPainter p(&writer);
+    const QRect page = QRect(QPoint(0, 0), writer.pageLayout().paintRectPixels(kResolution).size());
+    QRandomGenerator rng(kSeed + kind);
+    for (int i = 0; i < pageCount; ++i) {
+        if (i)
+            writer.newPage();
+        switch (kind) {
+        case Text:
+            paintText(p, page, rng);
+            break;
+        case Vector:
+            paintVector(p, page, rng);
+            break;
+        case Image:
+            paintImage(p, page, rng);
+            break;
+        case Long:
+            paintLong(p, page, rng, i);
+            break;
+        }
+    }
+    p.end();
+    QFile::rename(partial, doc.path);
+    return doc;
+}
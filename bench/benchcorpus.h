@@ -0,0 +1,45 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef BENCHCORPUS_H
+#define BENCHCORPUS_H
+
+#include <QString>
+#include <QVector>
+
+// Synthetic PDFs, generated locally with QPdfWriter, each stressing a
+// different part of the rasterizer.
+struct BenchDocument
+{
+    QString name;
+    QString path;
+    int pageCount = 0;
+};
+
+class BenchCorpus
+{
+public:
+    enum Kind {
+        Text,   // dense wrapped text, several fonts and sizes
+        Vector, // thousands of stroked and filled curves per page
+        Image,  // large embedded raster images
+        Long    // light pages, in large numbers
+    };
+
+    // Writes the documents into directory, unless already there
+    static QVector<BenchDocument> generate(const QString &directory, int longPageCount = 5000);
+    static BenchDocument generate(Kind kind, const QString &directory, int pageCount);
+};
+
+#endif // BENCHCORPUS_H
@@ -0,0 +1,382 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+// Render microbenchmark, built with qmake CONFIG+=bench.
+// Renders a synthetic corpus (see BenchCorpus) through PdfManager::render and
+// through the image provider pipeline, and prints one JSON object per line:
+//  - "latency": single threaded per-page render time, per raster width
+//  - "crop": same, rendering only a cropped area, as for cropped pages
+//  - "throughput": pages per second rendering from N threads at once, with
+//    as many document replicas as the largest N
+//  - "pipeline": pages per second through PdfImageProvider, that is
+//    scheduling, rendering, cropping and caching, as the viewer does.
+
+#include "benchcorpus.h"
+#include "pdfimageprovider.h"
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QThread>
+#include <QDebug>
+#include <QStandardPaths>
+#include <QSettings>
+#include <QSysInfo>
+#include <QDateTime>
+#include <QFile>
+#include <QTextStream>
+#include <QVector4D>
+#include <algorithm>
+
+namespace {
+struct Stats
+{
+    double min = 0;
+    double median = 0;
+    double p95 = 0;
+    double mean = 0;
+    int samples = 0;
+};
+
+Stats stats(QVector<double> ms)
+{
+    Stats s;
+    if (ms.isEmpty())
+        return s;
+    std::sort(ms.begin(), ms.end());
+    s.samples = ms.size();
+    s.min = ms.first();
+    s.median = ms.at(ms.size() / 2);
+    s.p95 = ms.at(qMin(ms.size() - 1, int(ms.size() * 0.95)));
+    double sum = 0;
+    for (double v: qAsConst(ms))
+        sum += v;
+    s.mean = sum / ms.size();
+    return s;
+}
+
+QJsonObject toJson(const Stats &s)
+{
+    return QJsonObject {
+        { QStringLiteral("min_ms"), s.min },
+        { QStringLiteral("median_ms"), s.median },
+        { QStringLiteral("p95_ms"), s.p95 },
+        { QStringLiteral("mean_ms"), s.mean },
+        { QStringLiteral("samples"), s.samples }
+    };
+}
+
+// Up to count pages, evenly spread over the document
+QVector<int> samplePages(int pageCount, int count)
+{
+    QVector<int> res;
+    count = qMin(count, pageCount);
+    for (int i = 0; i < count; ++i)
+        res.append(int(qint64(i) * pageCount / count));
+    return res;
+}
+
+QSize rasterSize(const QSizeF &pageSize, int width)
+{
+    return QSize(width, qRound(width * pageSize.height() / pageSize.width()));
+}
+
+// Same geometry as AsyncImageResponse uses for cropped pages
+void cropGeometry(const QSize &requestedSize, const QVector4D &margins, QSize &raster, QRect &crop)
+{
+    const qreal s = 1.0 / (1.0 - margins.x() - margins.z());
+    raster = QSize(qRound(requestedSize.width() * s), qRound(requestedSize.height() * s));
+    const int x = qRound(raster.width() * margins.x());
+    const int y = qRound(raster.height() * margins.y());
+    const int bottom = qRound(raster.height() * (1.0 - margins.w()));
+    crop = QRect(x, y, requestedSize.width(), qMax(1, bottom - y));
+}
+
+class RenderJob : public QRunnable
+{
+public:
+    RenderJob(PdfManager &manager, int documentId, int page, const QSize &size)
+        : m_manager(manager), m_documentId(documentId), m_page(page), m_size(size) {}
+
+    void run() override
+    {
+        m_manager.render(m_documentId, m_page, m_size);
+    }
+
+    PdfManager &m_manager;
+    int m_documentId;
+    int m_page;
+    QSize m_size;
+};
+
+class Bench
+{
+public:
+    Bench(QTextStream &out) : m_out(out) {}
+
+    void emitRecord(QJsonObject record)
+    {
+        m_out << QJsonDocument(record).toJson(QJsonDocument::Compact) << '\n';
+        m_out.flush();
+    }
+
+    int open(const BenchDocument &doc)
+    {
+        QEventLoop loop;
+        int id = -1;
+        bool failed = false;
+        // Loading is asynchronous: only the outcome of this document ends the wait
+        const QMetaObject::Connection ready = QObject::connect(&m_manager, &PdfManager::ready, &loop,
+                                                               [&](int documentId) {
+            if (documentId == id)
+                loop.quit();
+        });
+        const QMetaObject::Connection loadFailed = QObject::connect(&m_manager, &PdfManager::loadFailed, &loop,
+                                                                    [&](int documentId, const QString &error) {
+            if (documentId != id)
+                return;
+            qWarning() << "Load failed:" << error;
+            failed = true;
+            loop.quit();
+        });
+        QElapsedTimer t;
+        t.start();
+        id = m_manager.openDocument(QUrl(doc.path));
+        if (id >= 0)
+            loop.exec();
+        QObject::disconnect(ready);
+        QObject::disconnect(loadFailed);
+        if (id < 0 || failed)
+            return -1;
+        emitRecord({ { QStringLiteral("bench"), QStringLiteral("open") },
+                     { QStringLiteral("corpus"), doc.name },
+                     { QStringLiteral("pages"), m_manager.pageCount(id) },
+                     { QStringLiteral("ms"), t.nsecsElapsed() / 1e6 } });
+        return id;
+    }
+
+    void latency(const BenchDocument &doc, int id, const QVector<int> &widths, int samples)
+    {
+        const QVector<int> pages = samplePages(m_manager.pageCount(id), samples);
+        const QVector4D margins(0.1f, 0.1f, 0.1f, 0.1f);
+        for (int width: widths) {
+            QVector<double> full;
+            QVector<double> cropped;
+            m_manager.render(id, pages.first(), rasterSize(m_manager.pageSize(id, pages.first()), width)); // warm up
+            for (int page: pages) {
+                const QSize size = rasterSize(m_manager.pageSize(id, page), width);
+                QElapsedTimer t;
+                t.start();
+                m_manager.render(id, page, size);
+                full.append(t.nsecsElapsed() / 1e6);
+
+                QSize raster;
+                QRect crop;
+                cropGeometry(size, margins, raster, crop);
+                t.restart();
+                m_manager.render(id, page, raster, crop);
+                cropped.append(t.nsecsElapsed() / 1e6);
+            }
+            const Stats fullStats = stats(full);
+            const Stats croppedStats = stats(cropped);
+            QJsonObject record = toJson(fullStats);
+            record.insert(QStringLiteral("bench"), QStringLiteral("latency"));
+            record.insert(QStringLiteral("corpus"), doc.name);
+            record.insert(QStringLiteral("width"), width);
+            record.insert(QStringLiteral("threads"), 1);
+            emitRecord(record);
+
+            record = toJson(croppedStats);
+            record.insert(QStringLiteral("bench"), QStringLiteral("crop"));
+            record.insert(QStringLiteral("corpus"), doc.name);
+            record.insert(QStringLiteral("width"), width);
+            record.insert(QStringLiteral("threads"), 1);
+            record.insert(QStringLiteral("margins"), 0.1);
+            record.insert(QStringLiteral("ratio_to_full"),
+                          (fullStats.median > 0) ? croppedStats.median / fullStats.median : 0.0);
+            emitRecord(record);
+        }
+    }
+
+    void throughput(const BenchDocument &doc, int id, const QVector<int> &widths,
+                    const QVector<int> &threads, int samples)
+    {
+        const QVector<int> pages = samplePages(m_manager.pageCount(id), samples);
+        {
+            // Replicas are parsed on first use: not while timing
+            QThreadPool pool;
+            pool.setMaxThreadCount(m_manager.maxDocumentReplicas());
+            for (int i = 0; i < m_manager.maxDocumentReplicas(); ++i)
+                pool.start(new RenderJob(m_manager, id, pages.first(), QSize(64, 64)));
+            pool.waitForDone();
+        }
+        for (int width: widths) {
+            for (int threadCount: threads) {
+                QThreadPool pool;
+                pool.setMaxThreadCount(threadCount);
+                QElapsedTimer t;
+                t.start();
+                for (int page: pages)
+                    pool.start(new RenderJob(m_manager, id, page, rasterSize(m_manager.pageSize(id, page), width)));
+                pool.waitForDone();
+                const double seconds = t.nsecsElapsed() / 1e9;
+                emitRecord({ { QStringLiteral("bench"), QStringLiteral("throughput") },
+                             { QStringLiteral("corpus"), doc.name },
+                             { QStringLiteral("width"), width },
+                             { QStringLiteral("threads"), threadCount },
+                             { QStringLiteral("replicas"), m_manager.maxDocumentReplicas() },
+                             { QStringLiteral("pages"), pages.size() },
+                             { QStringLiteral("pages_per_s"), pages.size() / seconds } });
+            }
+        }
+    }
+
+    void pipeline(const BenchDocument &doc, int id, const QVector<int> &widths, int samples)
+    {
+        PdfImageProvider &provider = PdfImageProvider::instance();
+        const QVector<int> pages = samplePages(m_manager.pageCount(id), samples);
+        for (int width: widths) {
+            QEventLoop loop;
+            QAtomicInt pending(pages.size());
+            QVector<QQuickImageResponse *> responses;
+            QElapsedTimer t;
+            t.start();
+            for (int page: pages) {
+                const QString request = QString::number(id) + QLatin1Char('/') + QString::number(page)
+                        + QStringLiteral("/[0.10,0.10,0.10,0.10]/bench");
+                QQuickImageResponse *r = provider.requestImageResponse(request,
+                                                                       rasterSize(m_manager.pageSize(id, page), width));
+                QObject::connect(r, &QQuickImageResponse::finished, &loop, [&]() {
+                    if (!pending.deref())
+                        loop.quit();
+                }, Qt::QueuedConnection);
+                responses.append(r);
+            }
+            loop.exec();
+            const double seconds = t.nsecsElapsed() / 1e9;
+            qDeleteAll(responses);
+            emitRecord({ { QStringLiteral("bench"), QStringLiteral("pipeline") },
+                         { QStringLiteral("corpus"), doc.name },
+                         { QStringLiteral("width"), width },
+                         { QStringLiteral("threads"), provider.m_scheduler.threadCount() },
+                         { QStringLiteral("replicas"), m_manager.maxDocumentReplicas() },
+                         { QStringLiteral("pages"), pages.size() },
+                         { QStringLiteral("pages_per_s"), pages.size() / seconds } });
+        }
+    }
+
+    PdfManager m_manager;
+    QTextStream &m_out;
+};
+
+QVector<int> intList(const QString &csv)
+{
+    QVector<int> res;
+    for (const QString &v: csv.split(QLatin1Char(','), Qt::SkipEmptyParts)) {
+        bool ok = false;
+        const int i = v.toInt(&ok);
+        if (ok && i > 0)
+            res.append(i);
+    }
+    return res;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QGuiApplication app(argc, argv);
+    QCoreApplication::setOrganizationName(QStringLiteral("qdf.pw"));
+    QCoreApplication::setApplicationName(QStringLiteral("qdf-bench"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Page render microbenchmark. Prints JSON lines."));
+    parser.addHelpOption();
+    const QCommandLineOption corpusOption(QStringLiteral("corpus"),
+        QStringLiteral("Directory of the generated documents, reused across runs."),
+        QStringLiteral("dir"),
+        QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QStringLiteral("/corpus"));
+    const QCommandLineOption widthsOption(QStringLiteral("widths"),
+        QStringLiteral("Raster widths, comma separated."), QStringLiteral("list"), QStringLiteral("512,1024,2048"));
+    const QCommandLineOption threadsOption(QStringLiteral("threads"),
+        QStringLiteral("Thread counts, comma separated."), QStringLiteral("list"),
+        QStringLiteral("1,2,4,") + QString::number(QThread::idealThreadCount()));
+    const QCommandLineOption samplesOption(QStringLiteral("samples"),
+        QStringLiteral("Pages rendered per measurement."), QStringLiteral("n"), QStringLiteral("16"));
+    const QCommandLineOption longPagesOption(QStringLiteral("long-pages"),
+        QStringLiteral("Page count of the long document."), QStringLiteral("n"), QStringLiteral("5000"));
+    const QCommandLineOption outputOption(QStringLiteral("output"),
+        QStringLiteral("Write to file instead of stdout."), QStringLiteral("file"));
+    parser.addOptions({ corpusOption, widthsOption, threadsOption, samplesOption, longPagesOption, outputOption });
+    parser.process(app);
+
+    QVector<int> threads = intList(parser.value(threadsOption));
+    std::sort(threads.begin(), threads.end());
+    threads.erase(std::unique(threads.begin(), threads.end()), threads.end());
+    const QVector<int> widths = intList(parser.value(widthsOption));
+    const int samples = qMax(1, parser.value(samplesOption).toInt());
+
+    QFile outFile;
+    QTextStream out(stdout);
+    if (parser.isSet(outputOption)) {
+        outFile.setFileName(parser.value(outputOption));
+        if (!outFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+            qWarning() << "Cannot write" << outFile.fileName();
+            return 1;
+        }
+        out.setDevice(&outFile);
+    }
+
+    // Start from cold caches, and leave the user's caches and settings alone:
+    // everything the viewer persists goes to a scratch directory
+    QTemporaryDir cacheDir;
+    PdfImageProvider &provider = PdfImageProvider::instance();
+    provider.m_diskCache.setDirectory(cacheDir.path() + QStringLiteral("/pages"));
+    provider.m_thumbnails.setDirectory(cacheDir.path() + QStringLiteral("/thumbnails"));
+    provider.m_textIndex.setDirectory(cacheDir.path() + QStringLiteral("/textindex"));
+    QSettings::setDefaultFormat(QSettings::IniFormat);
+    QSettings::setPath(QSettings::IniFormat, QSettings::UserScope, cacheDir.path() + QStringLiteral("/settings"));
+
+    const QVector<BenchDocument> corpus = BenchCorpus::generate(parser.value(corpusOption),
+                                                                qMax(1, parser.value(longPagesOption).toInt()));
+    Bench bench(out);
+    // Thumbnails and text indexing would compete with the renders being timed
+    bench.m_manager.setBackgroundJobsEnabled(false);
+    // Otherwise every thread count contends for a single replica
+    bench.m_manager.setMaxDocumentReplicas(threads.isEmpty() ? 1 : threads.last());
+    bench.emitRecord({ { QStringLiteral("bench"), QStringLiteral("meta") },
+                       { QStringLiteral("qt"), QLatin1String(qVersion()) },
+                       { QStringLiteral("cpu"), QSysInfo::currentCpuArchitecture() },
+                       { QStringLiteral("os"), QSysInfo::prettyProductName() },
+                       { QStringLiteral("ideal_threads"), QThread::idealThreadCount() },
+                       { QStringLiteral("date"), QDateTime::currentDateTimeUtc().toString(Qt::ISODate) } });
+
+    for (const BenchDocument &doc: corpus) {
+        const int id = bench.open(doc);
+        if (id < 0) {
+            qWarning() << "Cannot open" << doc.path;
+            continue;
+        }
+        bench.latency(doc, id, widths, samples);
+        bench.throughput(doc, id, widths, threads, samples * 4);
+        bench.pipeline(doc, id, widths, samples * 4);
+        bench.m_manager.closeDocument(id);
+    }
+    return 0;
+}
@@ -9,6 +9,15 @@ CONFIG += qtquickcompiler
 HEADERS += $$files($$PWD/src/*.h)
 SOURCES += $$files($$PWD/src/*.cpp)
 
+# Render microbenchmark instead of the viewer: qmake CONFIG+=bench
+bench {
+    TARGET = qdf-bench
+    INCLUDEPATH += $$PWD/src
+    SOURCES -= $$PWD/src/main.cpp
+    HEADERS += $$files($$PWD/bench/*.h)
+    SOURCES += $$files($$PWD/bench/*.cpp)
+}
+
 qmlres.files = $$files($$PWD/src/qml/*.qml)
 qmlres.prefix = /
 qmlres.base = $$PWD/src/qml
@@ -0,0 +1,219 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "autocropper.h"
+#include "contentbounds.h"
+#include "pdfimageprovider.h"
+#include "tracelog.h"
+#include <QRunnable>
+#include <QVector4D>
+#include <QMutexLocker>
+
+class ContentBoundsJob : public QRunnable
+{
+public:
+    ContentBoundsJob(AutoCropper &cropper, PdfManager &manager, int documentId, int page, QSize size)
+        : m_cropper(cropper), m_manager(manager), m_documentId(documentId), m_page(page), m_size(size)
+    {
+        setAutoDelete(false); // owned by the AutoCropper
+    }
+
+    void run() override
+    {
+        TraceScope trace("autocrop", "ContentBoundsJob::run", QString::number(m_page));
+        QRectF bounds;
+        if (!m_cancelled.loadAcquire()) {
+            const QImage page = m_manager.render(m_documentId, m_page, m_size, QRect(),
+                                                 PdfManager::Grayscale);
+            const QRect r = contentBounds(page);
+            if (!r.isEmpty()) {
+                bounds = QRectF(qreal(r.x()) / page.width(),
+                                qreal(r.y()) / page.height(),
+                                qreal(r.width()) / page.width(),
+                                qreal(r.height()) / page.height());
+            }
+        }
+        m_cropper.pageAnalyzed(this, bounds);
+    }
+
+    AutoCropper &m_cropper;
+    PdfManager &m_manager;
+    int m_documentId;
+    int m_page;
+    QSize m_size;
+    QAtomicInt m_cancelled;
+};
+
+AutoCropper::AutoCropper(QObject *parent) : QObject(parent)
+{
+}
+
+AutoCropper::~AutoCropper()
+{
+    cancel();
+    QMutexLocker locker(&m_mutex);
+    while (!m_jobs.isEmpty())
+        m_jobsDone.wait(&m_mutex);
+}
+
+bool AutoCropper::running() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_documentId >= 0 && m_analyzed < m_pageCount;
+}
+
+qreal AutoCropper::progress() const
+{
+    QMutexLocker locker(&m_mutex);
+    return (m_pageCount) ? qreal(m_analyzed) / m_pageCount : 0.0;
+}
+
+void AutoCropper::analyze(int documentId, const QString &mode)
+{
+    cancel();
+    PdfImageProvider &provider = PdfImageProvider::instance();
+    PdfManager *manager = provider.m_manager;
+    if (!manager || !manager->isReady(documentId))
+        return;
+
+    const int pageCount = manager->pageCount(documentId);
+    if (pageCount <= 0) {
+        emit finished(documentId, QVariantList());
+        return;
+    }
+    {
+        QMutexLocker locker(&m_mutex);
+        m_documentId = documentId;
+        m_mode = mode;
+        m_pageCount = pageCount;
+        m_analyzed = 0;
+        m_bounds = QVector<QRectF>(pageCount);
+        for (int i = 0; i < pageCount; ++i) {
+            const QSizeF pageSize = manager->pageSize(documentId, i);
+            const int width = qMax(16, m_resolution);
+            const int height = (pageSize.width() > 0)
+                    ? qMax(16, qRound(width * pageSize.height() / pageSize.width()))
+                    : width;
+            ContentBoundsJob *job = new ContentBoundsJob(*this, *manager, documentId, i,
+                                                         QSize(width, height));
+            m_jobs.append(job);
+            provider.m_scheduler.start(job, documentId, i, RenderScheduler::Speculative);
+        }
+    }
+    emit runningChanged();
+    emit progressChanged();
+}
+
+void AutoCropper::cancel()
+{
+    bool wasRunning;
+    {
+        QMutexLocker locker(&m_mutex);
+        wasRunning = m_documentId >= 0 && m_analyzed < m_pageCount;
+        m_documentId = -1;
+        m_pageCount = 0;
+        m_analyzed = 0;
+        m_bounds.clear();
+        // Queued jobs are dropped, running ones report to nobody
+        for (int i = m_jobs.size() - 1; i >= 0; --i) {
+            ContentBoundsJob *job = m_jobs.at(i);
+            job->m_cancelled.storeRelease(1);
+            if (PdfImageProvider::instance().m_scheduler.tryTake(job)) {
+                m_jobs.remove(i);
+                delete job;
+            }
+        }
+    }
+    if (wasRunning) {
+        emit runningChanged();
+        emit progressChanged();
+    }
+}
+
+void AutoCropper::pageAnalyzed(ContentBoundsJob *job, const QRectF &bounds)
+{
+    QMutexLocker locker(&m_mutex);
+    m_jobs.removeOne(job);
+    if (!job->m_cancelled.loadAcquire() && job->m_documentId == m_documentId) {
+        m_bounds[job->m_page] = bounds;
+        ++m_analyzed;
+        QMetaObject::invokeMethod(this, "onPageAnalyzed", Qt::QueuedConnection);
+    }
+    delete job;
+    if (m_jobs.isEmpty())
+        m_jobsDone.wakeAll();
+}
+
+void AutoCropper::onPageAnalyzed()
+{
+    int documentId;
+    bool done;
+    {
+        QMutexLocker locker(&m_mutex);
+        documentId = m_documentId;
+        done = documentId >= 0 && m_analyzed == m_pageCount;
+    }
+    emit progressChanged();
+    if (!done)
+        return;
+    // Every page is in, and no job is left to touch m_bounds
+    const QVariantList margins = marginsFor(m_mode);
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_documentId != documentId) // cancelled meanwhile
+            return;
+        m_documentId = -1;
+        m_pageCount = 0;
+        m_analyzed = 0;
+    }
+    emit runningChanged();
+    emit finished(documentId, margins);
+}
+
+QVariantMap AutoCropper::entry(const QString &mode, const QRectF &bounds) const
+{
+    QVariantMap e;
+    e.insert(QStringLiteral("mode"), mode);
+    if (bounds.isNull()) {
+        e.insert(QStringLiteral("margins"), QVector4D(0, 0, 0, 0));
+        return e;
+    }
+    e.insert(QStringLiteral("margins"),
+             QVector4D(qMax(0.0, bounds.left() - m_padding),
+                       qMax(0.0, bounds.top() - m_padding),
+                       qMax(0.0, 1.0 - bounds.right() - m_padding),
+                       qMax(0.0, 1.0 - bounds.bottom() - m_padding)));
+    return e;
+}
+
+// Blank pages do not count towards the shared margins, and keep no margins
+// in "i" mode
+QVariantList AutoCropper::marginsFor(const QString &mode) const
+{
+    QMutexLocker locker(&m_mutex);
+    QVariantList res;
+    if (mode == QLatin1String("i")) {
+        for (const QRectF &b: m_bounds)
+            res.append(entry(mode, b));
+        return res;
+    }
+
+    const bool evenOdd = mode == QLatin1String("eo");
+    QRectF united[2];
+    for (int i = 0; i < m_bounds.size(); ++i)
+        united[(evenOdd) ? i % 2 : 0] |= m_bounds.at(i);
+    for (int i = 0; i < m_bounds.size(); ++i)
+        res.append(entry((evenOdd) ? mode : QStringLiteral("s"), united[(evenOdd) ? i % 2 : 0]));
+    return res;
+}
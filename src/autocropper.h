@@ -0,0 +1,89 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef AUTOCROPPER_H
+#define AUTOCROPPER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QRectF>
+#include <QSize>
+#include <QVariantList>
+#include <QVariantMap>
+#include <QAtomicInt>
+
+class ContentBoundsJob;
+
+// Detects the crop margins of a whole document in the background.
+// Every page is rendered at a low resolution, in grayscale, through the
+// render scheduler at speculative priority, so that interactive renders
+// always go first, and scanned for its content bounds (see contentBounds()).
+// The result is a list of { mode, margins } entries, one per page, as used by
+// PageCropper: mode "s" gives all pages the margins fitting the content of
+// every page, "eo" does the same for even and odd pages separately, "i"
+// fits each page on its own.
+class AutoCropper : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    Q_PROPERTY(qreal progress READ progress NOTIFY progressChanged)
+    // Width, in pixels, of the renders that are analyzed
+    Q_PROPERTY(int resolution MEMBER m_resolution NOTIFY resolutionChanged)
+    // Fraction of the page size left around the detected content
+    Q_PROPERTY(qreal padding MEMBER m_padding NOTIFY paddingChanged)
+public:
+    AutoCropper(QObject *parent = nullptr);
+    ~AutoCropper();
+
+    bool running() const;
+    qreal progress() const;
+
+    // Replaces any analysis in progress
+    Q_INVOKABLE void analyze(int documentId, const QString &mode);
+    Q_INVOKABLE void cancel();
+
+signals:
+    void runningChanged();
+    void progressChanged();
+    void resolutionChanged();
+    void paddingChanged();
+    void finished(int documentId, const QVariantList &margins);
+
+private slots:
+    void onPageAnalyzed();
+
+private:
+    friend class ContentBoundsJob;
+    // Worker threads
+    void pageAnalyzed(ContentBoundsJob *job, const QRectF &bounds);
+
+    QVariantList marginsFor(const QString &mode) const;
+    QVariantMap entry(const QString &mode, const QRectF &bounds) const;
+
+    int m_documentId = -1;
+    QString m_mode;
+    int m_resolution = 200;
+    qreal m_padding = 0.01;
+    int m_pageCount = 0;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_jobsDone;
+    QVector<ContentBoundsJob *> m_jobs; // queued or running
+    QVector<QRectF> m_bounds; // normalized, null for blank pages
+    int m_analyzed = 0;
+};
+
+#endif // AUTOCROPPER_H
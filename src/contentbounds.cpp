@@ -0,0 +1,107 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "contentbounds.h"
+#include <QVector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define QDF_CONTENTBOUNDS_NEON
+#endif
+
+namespace {
+// Consecutive content rows (columns) needed to start the box
+const int kMinRun = 2;
+
+// Folds row into the per-column minimums, and returns the minimum of row
+uchar accumulateRow(const uchar *row, uchar *columnMin, int width)
+{
+    int x = 0;
+    uchar rowMin = 255;
+#if defined(__SSE2__)
+    __m128i vmin = _mm_set1_epi8(char(0xff));
+    for (; x + 16 <= width; x += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x));
+        __m128i *c = reinterpret_cast<__m128i *>(columnMin + x);
+        _mm_storeu_si128(c, _mm_min_epu8(_mm_loadu_si128(c), v));
+        vmin = _mm_min_epu8(vmin, v);
+    }
+    vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 8));
+    vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 4));
+    vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 2));
+    vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 1));
+    rowMin = uchar(_mm_cvtsi128_si32(vmin) & 0xff);
+#elif defined(QDF_CONTENTBOUNDS_NEON)
+    uint8x16_t vmin = vdupq_n_u8(255);
+    for (; x + 16 <= width; x += 16) {
+        const uint8x16_t v = vld1q_u8(row + x);
+        vst1q_u8(columnMin + x, vminq_u8(vld1q_u8(columnMin + x), v));
+        vmin = vminq_u8(vmin, v);
+    }
+    uint8x8_t m = vmin_u8(vget_low_u8(vmin), vget_high_u8(vmin));
+    m = vpmin_u8(m, m);
+    m = vpmin_u8(m, m);
+    m = vpmin_u8(m, m);
+    rowMin = vget_lane_u8(m, 0);
+#endif
+    for (; x < width; ++x) {
+        columnMin[x] = qMin(columnMin[x], row[x]);
+        rowMin = qMin(rowMin, row[x]);
+    }
+    return rowMin;
+}
+
+// First index, from the front (step 1) or the back (step -1), starting a run
+// of kMinRun values below cutoff. -1 if none.
+int firstRun(const uchar *v, int count, int cutoff, int step)
+{
+    int run = 0;
+    for (int i = 0; i < count; ++i) {
+        const int idx = (step > 0) ? i : count - 1 - i;
+        if (v[idx] < cutoff) {
+            if (++run == qMin(kMinRun, count))
+                return idx - step * (run - 1);
+        } else {
+            run = 0;
+        }
+    }
+    return -1;
+}
+} // namespace
+
+QRect contentBounds(const QImage &gray, int threshold)
+{
+    if (gray.isNull() || gray.format() != QImage::Format_Grayscale8)
+        return QRect();
+    const int w = gray.width();
+    const int h = gray.height();
+    const int cutoff = 255 - qBound(0, threshold, 255);
+
+    QVector<uchar> columnMin(w, 255);
+    QVector<uchar> rowMin(h);
+    for (int y = 0; y < h; ++y)
+        rowMin[y] = accumulateRow(gray.constScanLine(y), columnMin.data(), w);
+
+    const int top = firstRun(rowMin.constData(), h, cutoff, 1);
+    if (top < 0)
+        return QRect();
+    const int bottom = firstRun(rowMin.constData(), h, cutoff, -1);
+    const int left = firstRun(columnMin.constData(), w, cutoff, 1);
+    const int right = firstRun(columnMin.constData(), w, cutoff, -1);
+    if (left < 0 || bottom < top || right < left)
+        return QRect();
+    return QRect(QPoint(left, top), QPoint(right, bottom));
+}
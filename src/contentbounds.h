@@ -0,0 +1,29 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef CONTENTBOUNDS_H
+#define CONTENTBOUNDS_H
+
+#include <QImage>
+#include <QRect>
+
+// Bounding box of the content of a rendered page: the pixels of a Grayscale8
+// image darker than 255 - threshold. Content thinner than two pixels at the
+// edges of the box is taken for noise, e.g. dust on scanned pages.
+// Returns an empty rect for blank pages.
+// The image is scanned once, 16 pixels at a time where SSE2 or NEON are
+// available.
+QRect contentBounds(const QImage &gray, int threshold = 24);
+
+#endif // CONTENTBOUNDS_H
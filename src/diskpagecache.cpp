@@ -0,0 +1,395 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "diskpagecache.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QScopedPointer>
+#include <QMutexLocker>
+#include <QSet>
+#include <QStandardPaths>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+const quint32 cacheMagic = 0x43464451; // "QDFC"
+const quint32 cacheVersion = 1;
+const quint32 cacheEntries = 2048;
+const qint64 dataAlignment = 16;
+
+struct CacheHeader
+{
+    quint32 magic;
+    quint32 version;
+    quint32 entryCount;
+    quint32 reserved;
+    quint64 dataOffset;
+    quint64 dataSize;
+    quint64 useCounter;
+};
+
+struct CacheEntry
+{
+    qint32 page;
+    qint32 bucket;
+    qint32 requestedWidth;
+    qint32 requestedHeight;
+    float margins[4];
+    qint32 width;
+    qint32 height;
+    qint32 bytesPerLine;
+    qint32 format;
+    quint64 offset; // relative to dataOffset
+    quint64 bytes;
+    quint64 lastUse;
+    quint32 valid;
+    quint32 colorMode; // 0, color, in entries written before it existed
+};
+
+qint64 alignUp(qint64 v, qint64 a)
+{
+    return (v + a - 1) / a * a;
+}
+
+// The formats insert() stores: rendered pages as prepared for upload
+int bytesPerPixel(qint32 format)
+{
+    switch (format) {
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_RGBA8888_Premultiplied:
+        return 4;
+    case QImage::Format_Grayscale8:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Whether e describes an image that lies within the data area. Entries are
+// not trusted: the file may be truncated, corrupt or written by another
+// version
+bool isSane(const CacheEntry &e, quint64 dataSize)
+{
+    const int bpp = bytesPerPixel(e.format);
+    return bpp
+            && e.width > 0 && e.height > 0
+            && e.offset <= dataSize && e.bytes <= dataSize - e.offset
+            && qint64(e.bytesPerLine) >= qint64(e.width) * bpp
+            && quint64(e.bytesPerLine) * quint64(e.height) <= e.bytes;
+}
+
+bool sameSlot(const CacheEntry &e, const PageRenderKey &key)
+{
+    return e.page == key.page
+            && e.bucket == DiskPageCache::resolutionBucket(key.size)
+            && e.colorMode == quint32(key.colorMode)
+            && e.margins[0] == key.margins.x()
+            && e.margins[1] == key.margins.y()
+            && e.margins[2] == key.margins.z()
+            && e.margins[3] == key.margins.w();
+}
+} // namespace
+
+struct DiskPageCache::DocumentFile
+{
+    QFile file;
+    // Other instances opening the same document leave the file alone
+    QScopedPointer<QLockFile> lock;
+    uchar *map = nullptr;
+
+    CacheHeader *header()
+    {
+        return reinterpret_cast<CacheHeader *>(map);
+    }
+    CacheEntry *entries()
+    {
+        return reinterpret_cast<CacheEntry *>(map + sizeof(CacheHeader));
+    }
+    uchar *data()
+    {
+        return map + header()->dataOffset;
+    }
+
+    bool open(const QString &path, qint64 capacity)
+    {
+        lock.reset(new QLockFile(path + QStringLiteral(".lock")));
+        if (!lock->tryLock(0))
+            return false;
+        file.setFileName(path);
+        if (!file.open(QIODevice::ReadWrite))
+            return false;
+        const qint64 dataOffset = alignUp(sizeof(CacheHeader) + cacheEntries * sizeof(CacheEntry), 4096);
+        const qint64 size = qMax(capacity, dataOffset + 4096);
+        bool valid = file.size() == size;
+        if (!valid && !file.resize(size))
+            return false;
+        map = file.map(0, size);
+        if (!map)
+            return false;
+        CacheHeader *h = header();
+        valid = valid
+                && h->magic == cacheMagic
+                && h->version == cacheVersion
+                && h->entryCount == cacheEntries
+                && h->dataOffset == quint64(dataOffset)
+                && h->dataSize == quint64(size - dataOffset);
+        if (!valid) {
+            memset(map, 0, dataOffset);
+            h->magic = cacheMagic;
+            h->version = cacheVersion;
+            h->entryCount = cacheEntries;
+            h->dataOffset = dataOffset;
+            h->dataSize = size - dataOffset;
+            h->useCounter = 0;
+        }
+        return true;
+    }
+
+    ~DocumentFile()
+    {
+        if (map)
+            file.unmap(map);
+        file.close();
+        // lock goes last
+    }
+
+    // First fit among the gaps left by the valid entries, or -1
+    qint64 findGap(qint64 bytes)
+    {
+        QVector<QPair<qint64, qint64>> used;
+        CacheEntry *e = entries();
+        for (quint32 i = 0; i < cacheEntries; ++i) {
+            if (e[i].valid)
+                used.append(qMakePair(qint64(e[i].offset), qint64(e[i].bytes)));
+        }
+        std::sort(used.begin(), used.end());
+        qint64 start = 0;
+        for (const auto &u: qAsConst(used)) {
+            if (u.first - start >= bytes)
+                return start;
+            start = qMax(start, alignUp(u.first + u.second, dataAlignment));
+        }
+        if (qint64(header()->dataSize) - start >= bytes)
+            return start;
+        return -1;
+    }
+
+    // Invalidates the least recently used entry. Returns false if there was none
+    bool evictOne()
+    {
+        CacheEntry *e = entries();
+        int lru = -1;
+        for (quint32 i = 0; i < cacheEntries; ++i) {
+            if (e[i].valid && (lru < 0 || e[i].lastUse < e[lru].lastUse))
+                lru = int(i);
+        }
+        if (lru < 0)
+            return false;
+        e[lru].valid = 0;
+        return true;
+    }
+};
+
+DiskPageCache::DiskPageCache()
+    : m_fileCapacity(128ll * 1024 * 1024)
+    , m_directoryBudget(1024ll * 1024 * 1024)
+{
+    m_directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+            + QStringLiteral("/pages");
+}
+
+DiskPageCache::~DiskPageCache()
+{
+    qDeleteAll(m_files);
+}
+
+void DiskPageCache::openDocument(int documentId, const QString &documentKey)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_files.contains(documentId) || documentKey.isEmpty() || m_fileCapacity <= 0)
+        return;
+    if (!QDir().mkpath(m_directory))
+        return;
+
+    const QString name = QString::fromLatin1(
+                QCryptographicHash::hash(documentKey.toUtf8(), QCryptographicHash::Sha1).toHex())
+            + QStringLiteral(".pages");
+    DocumentFile *f = new DocumentFile;
+    if (!f->open(m_directory + QLatin1Char('/') + name, m_fileCapacity)) {
+        qWarning() << "DiskPageCache: cannot use" << f->file.fileName() << f->file.errorString();
+        delete f;
+        return;
+    }
+    // Opening a document touches its file, so the oldest ones go first when trimming
+    f->file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    m_files.insert(documentId, f);
+    trimDirectory();
+}
+
+void DiskPageCache::closeDocument(int documentId)
+{
+    QMutexLocker locker(&m_mutex);
+    delete m_files.take(documentId);
+}
+
+bool DiskPageCache::find(const PageRenderKey &key, QImage &image)
+{
+    if (key.tile.isValid())
+        return false;
+    QMutexLocker locker(&m_mutex);
+    DocumentFile *f = m_files.value(key.documentId);
+    if (!f)
+        return false;
+
+    CacheEntry *e = f->entries();
+    for (quint32 i = 0; i < cacheEntries; ++i) {
+        if (!e[i].valid
+                || !sameSlot(e[i], key)
+                || e[i].requestedWidth != key.size.width()
+                || e[i].requestedHeight != key.size.height())
+            continue;
+        if (!isSane(e[i], f->header()->dataSize)) {
+            e[i].valid = 0;
+            continue;
+        }
+        e[i].lastUse = ++f->header()->useCounter;
+        // Copied out, as the mapped bytes may be reused after eviction
+        image = QImage(f->data() + e[i].offset,
+                       e[i].width,
+                       e[i].height,
+                       e[i].bytesPerLine,
+                       QImage::Format(e[i].format)).copy();
+        return !image.isNull();
+    }
+    return false;
+}
+
+void DiskPageCache::insert(const PageRenderKey &key, const QImage &image)
+{
+    if (key.tile.isValid() || image.isNull() || !bytesPerPixel(image.format()))
+        return;
+    QMutexLocker locker(&m_mutex);
+    DocumentFile *f = m_files.value(key.documentId);
+    if (!f)
+        return;
+
+    const qint64 bytes = image.sizeInBytes();
+    if (bytes > qint64(f->header()->dataSize))
+        return;
+
+    CacheEntry *e = f->entries();
+    int slot = -1;
+    for (quint32 i = 0; i < cacheEntries; ++i) {
+        if (e[i].valid && sameSlot(e[i], key))
+            e[i].valid = 0; // replaced by the new resolution in the same bucket
+        if (!e[i].valid && slot < 0)
+            slot = int(i);
+    }
+
+    qint64 offset = f->findGap(bytes);
+    while (offset < 0 || slot < 0) {
+        if (!f->evictOne())
+            return;
+        if (slot < 0) {
+            for (quint32 i = 0; i < cacheEntries && slot < 0; ++i) {
+                if (!e[i].valid)
+                    slot = int(i);
+            }
+        }
+        offset = f->findGap(bytes);
+    }
+
+    memcpy(f->data() + offset, image.constBits(), size_t(bytes));
+    CacheEntry &entry = e[slot];
+    entry.page = key.page;
+    entry.bucket = resolutionBucket(key.size);
+    entry.requestedWidth = key.size.width();
+    entry.requestedHeight = key.size.height();
+    entry.margins[0] = key.margins.x();
+    entry.margins[1] = key.margins.y();
+    entry.margins[2] = key.margins.z();
+    entry.margins[3] = key.margins.w();
+    entry.width = image.width();
+    entry.height = image.height();
+    entry.bytesPerLine = image.bytesPerLine();
+    entry.format = int(image.format());
+    entry.colorMode = quint32(key.colorMode);
+    entry.offset = quint64(offset);
+    entry.bytes = quint64(bytes);
+    entry.lastUse = ++f->header()->useCounter;
+    entry.valid = 1; // last, so that a partially written entry is never valid
+}
+
+QString DiskPageCache::directory() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_directory;
+}
+
+void DiskPageCache::setDirectory(const QString &path)
+{
+    QMutexLocker locker(&m_mutex);
+    m_directory = path;
+}
+
+qint64 DiskPageCache::fileCapacity() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_fileCapacity;
+}
+
+// Applies to documents opened afterwards. Existing files of a different
+// capacity are reinitialized when opened.
+void DiskPageCache::setFileCapacity(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_fileCapacity = bytes;
+}
+
+qint64 DiskPageCache::directoryBudget() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_directoryBudget;
+}
+
+void DiskPageCache::setDirectoryBudget(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_directoryBudget = bytes;
+}
+
+void DiskPageCache::trimDirectory()
+{
+    QSet<QString> inUse;
+    for (DocumentFile *f: qAsConst(m_files))
+        inUse.insert(QFileInfo(f->file).absoluteFilePath());
+
+    QDir dir(m_directory);
+    const QFileInfoList files = dir.entryInfoList(QStringList() << QStringLiteral("*.pages"),
+                                                  QDir::Files,
+                                                  QDir::Time);
+    qint64 total = 0;
+    for (const QFileInfo &fi: files) {
+        total += fi.size();
+        if (total <= m_directoryBudget || inUse.contains(fi.absoluteFilePath()))
+            continue;
+        QLockFile lock(fi.absoluteFilePath() + QStringLiteral(".lock"));
+        if (lock.tryLock(0)) // not in use by another instance either
+            QFile::remove(fi.absoluteFilePath());
+    }
+}
@@ -0,0 +1,70 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef DISKPAGECACHE_H
+#define DISKPAGECACHE_H
+
+#include <QFile>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+#include "pagerendercache.h"
+
+// Persistent cache of rendered pages. Each document has its own file, named
+// after the same fileName + bytesCount key used for the per-document settings,
+// that is memory mapped and holds at most one bitmap per page, margins and
+// resolution bucket. Files are capped in size and evict least recently used
+// bitmaps. The cache directory as a whole is capped as well, dropping the
+// least recently opened documents.
+// Only whole pages are stored, tiles are not.
+// A file is used by one process at a time, under a lock file, and its entries
+// are validated against the mapping before being read.
+class DiskPageCache
+{
+public:
+    DiskPageCache();
+    ~DiskPageCache();
+
+    void openDocument(int documentId, const QString &documentKey);
+    void closeDocument(int documentId);
+
+    bool find(const PageRenderKey &key, QImage &image);
+    void insert(const PageRenderKey &key, const QImage &image);
+
+    QString directory() const;
+    void setDirectory(const QString &path);
+    qint64 fileCapacity() const;
+    void setFileCapacity(qint64 bytes);
+    qint64 directoryBudget() const;
+    void setDirectoryBudget(qint64 bytes);
+
+    // Requests whose width falls in the same bucket replace each other
+    static int resolutionBucket(const QSize &size)
+    {
+        return size.width() >> 7;
+    }
+
+private:
+    struct DocumentFile;
+    void trimDirectory();
+
+    mutable QMutex m_mutex;
+    QHash<int, DocumentFile *> m_files;
+    QString m_directory;
+    qint64 m_fileCapacity;
+    qint64 m_directoryBudget;
+};
+
+#endif // DISKPAGECACHE_H
@@ -0,0 +1,121 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "documentreplicapool.h"
+#include "mappeddocumentfile.h"
+#include <QPdfDocument>
+#include <QMutexLocker>
+#include <QDebug>
+
+DocumentReplicaPool::DocumentReplicaPool(const QString &filePath, int maxReplicas)
+    : m_filePath(filePath), m_maxReplicas(qMax(1, maxReplicas))
+{
+}
+
+DocumentReplicaPool::~DocumentReplicaPool()
+{
+    // Leases hold a reference to the pool, so all replicas are idle by now
+    qDeleteAll(m_idle);
+}
+
+QSharedPointer<MappedDocumentFile> DocumentReplicaPool::mapping()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_mapped) {
+        m_mapped = true;
+        m_mapping = MappedDocumentFile::open(m_filePath);
+        if (!m_mapping)
+            qWarning() << "DocumentReplicaPool: cannot map" << m_filePath << ", reading it instead";
+    }
+    return m_mapping;
+}
+
+bool DocumentReplicaPool::load(QPdfDocument *document)
+{
+    if (MappedDocumentFile::load(document, mapping()))
+        return true;
+    return document->load(m_filePath) == QPdfDocument::NoError
+            && document->status() == QPdfDocument::Ready;
+}
+
+QPdfDocument *DocumentReplicaPool::createReplica()
+{
+    QPdfDocument *replica = new QPdfDocument;
+    if (!load(replica)) {
+        qWarning() << "DocumentReplicaPool: failed loading" << m_filePath;
+        delete replica;
+        return nullptr;
+    }
+    replica->moveToThread(nullptr); // usable, and deletable, from any worker
+    return replica;
+}
+
+QPdfDocument *DocumentReplicaPool::acquire()
+{
+    QMutexLocker locker(&m_mutex);
+    forever {
+        if (m_failed)
+            return nullptr;
+        if (!m_idle.isEmpty())
+            return m_idle.takeLast();
+        if (m_replicas < m_maxReplicas)
+            break;
+        m_released.wait(&m_mutex);
+    }
+
+    ++m_replicas;
+    locker.unlock(); // loading can take a while
+    QPdfDocument *replica = createReplica();
+    locker.relock();
+    if (!replica) {
+        --m_replicas;
+        m_failed = true;
+        m_released.wakeAll();
+    }
+    return replica;
+}
+
+void DocumentReplicaPool::adopt(QPdfDocument *document)
+{
+    if (document)
+        document->moveToThread(nullptr); // usable, and deletable, from any worker
+    QMutexLocker locker(&m_mutex);
+    if (document) {
+        m_idle.append(document);
+        m_released.wakeOne();
+    } else {
+        --m_replicas;
+        m_failed = true;
+        m_released.wakeAll();
+    }
+}
+
+void DocumentReplicaPool::release(QPdfDocument *replica)
+{
+    QMutexLocker locker(&m_mutex);
+    m_idle.append(replica);
+    m_released.wakeOne();
+}
+
+int DocumentReplicaPool::replicaCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_replicas;
+}
+
+int DocumentReplicaPool::idleCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_idle.size();
+}
@@ -0,0 +1,98 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef DOCUMENTREPLICAPOOL_H
+#define DOCUMENTREPLICAPOOL_H
+
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <QWaitCondition>
+#include <QSharedPointer>
+
+class QPdfDocument;
+class MappedDocumentFile;
+
+// The QPdfDocument handles on a file, leased by the threads that query
+// pdfium for it. The first one is the document DocumentLoadJob parses when
+// opening the file, handed over with adopt(): acquire() blocks until then.
+// QtPdf serializes every pdfium call on one global lock, so replicas never
+// render in parallel, while each further one costs a full parse and its own
+// memory: one is the default. Further ones only make sense with a pdfium
+// build that allows concurrent documents, and are created lazily, up to
+// maxReplicas. Replicas are not bound to any thread. They all read the file
+// through one shared read-only mapping, when the file can be mapped.
+class DocumentReplicaPool
+{
+public:
+    static const int DefaultMaxReplicas = 1;
+
+    DocumentReplicaPool(const QString &filePath, int maxReplicas);
+    ~DocumentReplicaPool();
+
+    // Returns an idle replica, creating one if needed. Blocks while all
+    // maxReplicas are in use, or the first one is still loading. Returns
+    // nullptr if the file cannot be loaded.
+    QPdfDocument *acquire();
+    void release(QPdfDocument *replica);
+
+    // Hands over the first replica, loaded with load(), or reports that it
+    // could not be loaded (document null)
+    void adopt(QPdfDocument *document);
+
+    // The mapping of the file, created on first use. Null if the file cannot
+    // be mapped, in which case documents load from the path.
+    QSharedPointer<MappedDocumentFile> mapping();
+    // Loads document from mapping(), or from the path as a fallback
+    bool load(QPdfDocument *document);
+
+    int replicaCount() const;
+    int idleCount() const;
+
+    class Lease
+    {
+    public:
+        Lease(const QSharedPointer<DocumentReplicaPool> &pool)
+            : m_pool(pool), m_document(pool ? pool->acquire() : nullptr) {}
+        ~Lease()
+        {
+            if (m_document)
+                m_pool->release(m_document);
+        }
+        QPdfDocument *document() const
+        {
+            return m_document;
+        }
+
+    private:
+        Q_DISABLE_COPY(Lease)
+        QSharedPointer<DocumentReplicaPool> m_pool; // keeps the pool alive past closeDocument
+        QPdfDocument *m_document;
+    };
+
+private:
+    QPdfDocument *createReplica();
+
+    const QString m_filePath;
+    const int m_maxReplicas;
+    mutable QMutex m_mutex;
+    QWaitCondition m_released;
+    QVector<QPdfDocument *> m_idle;
+    QSharedPointer<MappedDocumentFile> m_mapping;
+    bool m_mapped = false; // mapping attempted
+    int m_replicas = 1; // including the ones being created, and the adopted one
+    bool m_failed = false;
+};
+
+#endif // DOCUMENTREPLICAPOOL_H
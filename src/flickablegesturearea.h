@@ -19,6 +19,7 @@ In addition to the above,
 #include <QLineF>
 #include <QDebug>
 #include <QDateTime>
+#include "tracelog.h"
 
 class FlickableGestureArea : public QQuickItem
 {
@@ -84,6 +85,7 @@ protected:
 
 
     void touchEvent(QTouchEvent *touchEvent) override {
+        TraceScope trace("input", "FlickableGestureArea::touchEvent");
         switch (touchEvent->type()) {
         case QTouchEvent::TouchBegin:
         case QTouchEvent::TouchUpdate: // only getting touchUpdate!
@@ -153,6 +155,7 @@ protected:
 
     void wheelEvent(QWheelEvent* wheelEvent) override
     {
+        TraceScope trace("input", "FlickableGestureArea::wheelEvent");
         //mCurrentFactor = zoom(mCurrentFactor + (wheelEvent->angleDelta().y() > 0? 1:-1) * mWheelFactor);
         qWarning() << "WheelEvent mods:"<<wheelEvent->modifiers();
         if (wheelEvent->modifiers().testFlag(Qt::ControlModifier)) {
@@ -0,0 +1,101 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "imagememorygovernor.h"
+#include "qquickflickerlessimage.h"
+#include <QVector>
+#include <algorithm>
+
+ImageMemoryGovernor &ImageMemoryGovernor::instance()
+{
+    static ImageMemoryGovernor governor;
+    return governor;
+}
+
+ImageMemoryGovernor::ImageMemoryGovernor()
+    : m_budget(384ll * 1024 * 1024)
+{
+    m_enforceTimer.setSingleShot(true);
+    m_enforceTimer.setInterval(0);
+    connect(&m_enforceTimer, &QTimer::timeout, this, &ImageMemoryGovernor::enforce);
+}
+
+void ImageMemoryGovernor::setUsage(QQuickFlickerlessImage *image, qint64 cpuBytes, qint64 gpuBytes)
+{
+    Usage &u = m_images[image];
+    m_usage += cpuBytes + gpuBytes - u.cpu - u.gpu;
+    u.cpu = cpuBytes;
+    u.gpu = gpuBytes;
+    if (m_usage > m_budget && !m_enforceTimer.isActive())
+        m_enforceTimer.start();
+}
+
+void ImageMemoryGovernor::remove(QQuickFlickerlessImage *image)
+{
+    auto it = m_images.find(image);
+    if (it == m_images.end())
+        return;
+    m_usage -= it->cpu + it->gpu;
+    m_images.erase(it);
+}
+
+qint64 ImageMemoryGovernor::usage() const
+{
+    return m_usage;
+}
+
+qint64 ImageMemoryGovernor::budget() const
+{
+    return m_budget;
+}
+
+void ImageMemoryGovernor::setBudget(qint64 bytes)
+{
+    if (bytes == m_budget)
+        return;
+    m_budget = bytes;
+    emit budgetChanged();
+    if (m_usage > m_budget)
+        m_enforceTimer.start();
+}
+
+void ImageMemoryGovernor::enforce()
+{
+    if (m_usage <= m_budget)
+        return;
+
+    QVector<QPair<qreal, QQuickFlickerlessImage *>> candidates;
+    for (auto it = m_images.cbegin(); it != m_images.cend(); ++it) {
+        QQuickFlickerlessImage *image = it.key();
+        if (it->cpu + it->gpu > 0 && !image->isOnScreen())
+            candidates.append(qMakePair(image->viewportDistance(), image));
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const QPair<qreal, QQuickFlickerlessImage *> &a,
+                 const QPair<qreal, QQuickFlickerlessImage *> &b) {
+        return a.first > b.first;
+    });
+
+    // Placeholders first, everything then. Reducing an image reports its
+    // new usage synchronously.
+    for (int level = QQuickFlickerlessImage::Reduced;
+         level <= QQuickFlickerlessImage::Released && m_usage > m_budget; ++level) {
+        for (const auto &c: qAsConst(candidates)) {
+            if (m_usage <= m_budget)
+                break;
+            if (c.second->memoryLevel() < level)
+                c.second->reduceMemory(QQuickFlickerlessImage::MemoryLevel(level));
+        }
+    }
+}
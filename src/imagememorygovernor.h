@@ -0,0 +1,63 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef IMAGEMEMORYGOVERNOR_H
+#define IMAGEMEMORYGOVERNOR_H
+
+#include <QObject>
+#include <QHash>
+#include <QTimer>
+
+class QQuickFlickerlessImage;
+
+// Process wide budget for the memory held by FlickerlessImages: the images
+// of their pixmaps and tiles, and the textures made out of them.
+// Images report their usage whenever it changes. When the total exceeds the
+// budget, off-screen images are reduced, farthest from their viewport first:
+// first to a low resolution placeholder, then, if that is not enough, to
+// nothing. They reload once back on screen.
+// GUI thread only.
+class ImageMemoryGovernor : public QObject
+{
+    Q_OBJECT
+public:
+    static ImageMemoryGovernor &instance();
+
+    void setUsage(QQuickFlickerlessImage *image, qint64 cpuBytes, qint64 gpuBytes);
+    void remove(QQuickFlickerlessImage *image);
+
+    qint64 usage() const; // CPU + GPU
+    qint64 budget() const;
+    void setBudget(qint64 bytes);
+
+signals:
+    void budgetChanged();
+
+private:
+    ImageMemoryGovernor();
+    void enforce();
+
+    struct Usage
+    {
+        qint64 cpu = 0;
+        qint64 gpu = 0;
+    };
+
+    QHash<QQuickFlickerlessImage *, Usage> m_images;
+    qint64 m_usage = 0;
+    qint64 m_budget;
+    QTimer m_enforceTimer; // coalesces the reports of one event loop pass
+};
+
+#endif // IMAGEMEMORYGOVERNOR_H
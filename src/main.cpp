@@ -26,6 +26,10 @@ In addition to the above,
 
 #include "flickablegesturearea.h"
 #include "pdfimageprovider.h"
+#include "pageprefetcher.h"
+#include "autocropper.h"
+#include "pageoverview.h"
+#include "tracelog.h"
 #include "qquickflickerlessimage.h"
 
 class DragDistanceChanger: public QObject
@@ -69,10 +73,16 @@ int main(int argc, char *argv[])
     qmlRegisterType<PdfManager>(uri, major, minor, "PdfManager");
     qmlRegisterType<QQuickFlickerlessImage>(uri, major, minor, "FlickerlessImage");
     qmlRegisterType<FlickableGestureArea>(uri, major, minor, "FlickableGestureArea");
+    qmlRegisterType<PagePrefetcher>(uri, major, minor, "PagePrefetcher");
+    qmlRegisterType<AutoCropper>(uri, major, minor, "AutoCropper");
+    qmlRegisterType<PageOverview>(uri, major, minor, "PageOverview");
+    qmlRegisterUncreatableType<PdfPageModel>(uri, major, minor, "PdfPageModel",
+                                             QStringLiteral("Returned by PdfManager.pages()"));
     qmlRegisterType<QQmlPropertyMap>(uri, major, minor, "QmlObject");
 
     PdfImageProvider &provider = PdfImageProvider::instance();
     engine.addImageProvider("pdfpages", &provider);
+    engine.addImageProvider("pdfthumbs", new ThumbnailImageProvider(provider.m_thumbnails));
 
 #if defined(Q_OS_ANDROID)
     engine.rootContext()->setContextProperty(QStringLiteral("platform_name"), QVariant::fromValue(QStringLiteral("mobile")));
@@ -87,6 +97,23 @@ int main(int argc, char *argv[])
     dragChanger.connect(root, SIGNAL(dprChanged()), SLOT(changeDragDistance()));
     dragChanger.changeDragDistance();
 
+    QQuickWindow *win = qobject_cast<QQuickWindow *>(root);
+    if (win && TraceLog::isEnabled()) {
+        // Texture uploads happen within the render pass, on the render thread
+        QObject::connect(win, &QQuickWindow::beforeSynchronizing, win, []() {
+            TraceLog::instance().begin("scenegraph", "sync");
+        }, Qt::DirectConnection);
+        QObject::connect(win, &QQuickWindow::afterSynchronizing, win, []() {
+            TraceLog::instance().end("scenegraph", "sync");
+        }, Qt::DirectConnection);
+        QObject::connect(win, &QQuickWindow::beforeRendering, win, []() {
+            TraceLog::instance().begin("scenegraph", "render");
+        }, Qt::DirectConnection);
+        QObject::connect(win, &QQuickWindow::afterRendering, win, []() {
+            TraceLog::instance().end("scenegraph", "render");
+        }, Qt::DirectConnection);
+    }
+
 //    QFile frag(":/assets/shaders/texture_frag.glsl");
 //    frag.open(QIODevice::ReadOnly | QIODevice::Text);
 //    qDebug().noquote() << frag.readAll();
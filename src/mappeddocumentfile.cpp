@@ -0,0 +1,81 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "mappeddocumentfile.h"
+#include <QBuffer>
+#include <QPdfDocument>
+#include <limits>
+
+namespace {
+// Reads from the mapping without copying it, and holds it for as long as
+// the document it belongs to
+class MappedDevice : public QBuffer
+{
+public:
+    MappedDevice(const QSharedPointer<MappedDocumentFile> &mapping, const QByteArray &data,
+                 QObject *parent)
+        : QBuffer(parent), m_mapping(mapping)
+    {
+        setData(data);
+        open(QIODevice::ReadOnly);
+    }
+
+private:
+    QSharedPointer<MappedDocumentFile> m_mapping;
+};
+} // namespace
+
+QSharedPointer<MappedDocumentFile> MappedDocumentFile::open(const QString &filePath)
+{
+    QSharedPointer<MappedDocumentFile> m(new MappedDocumentFile);
+    m->m_file.setFileName(filePath);
+    if (!m->m_file.open(QIODevice::ReadOnly))
+        return QSharedPointer<MappedDocumentFile>();
+    m->m_size = m->m_file.size();
+    if (m->m_size <= 0)
+        return QSharedPointer<MappedDocumentFile>();
+    m->m_data = m->m_file.map(0, m->m_size);
+    if (!m->m_data)
+        return QSharedPointer<MappedDocumentFile>();
+    // The mapping stays valid once the file is closed
+    m->m_file.close();
+    return m;
+}
+
+MappedDocumentFile::~MappedDocumentFile()
+{
+    if (m_data)
+        m_file.unmap(m_data);
+}
+
+qint64 MappedDocumentFile::size() const
+{
+    return m_size;
+}
+
+bool MappedDocumentFile::load(QPdfDocument *document, const QSharedPointer<MappedDocumentFile> &mapping)
+{
+    if (!mapping || mapping->m_size > std::numeric_limits<int>::max())
+        return false; // QByteArray sizes are int
+    const QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char *>(mapping->m_data),
+                                                    int(mapping->m_size));
+    MappedDevice *device = new MappedDevice(mapping, data, document);
+    // Non sequential devices load synchronously
+    document->load(device);
+    if (document->status() == QPdfDocument::Ready)
+        return true;
+    document->close(); // drops its pointer to device
+    delete device;
+    return false;
+}
@@ -0,0 +1,54 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef MAPPEDDOCUMENTFILE_H
+#define MAPPEDDOCUMENTFILE_H
+
+#include <QFile>
+#include <QSharedPointer>
+#include <QString>
+
+class QIODevice;
+class QObject;
+class QPdfDocument;
+
+// Read-only memory mapping of a document file, shared by all the
+// QPdfDocuments opened on it (the replicas of its DocumentReplicaPool).
+// pdfium reads straight from the mapping through a QIODevice, so
+// the file data lives in the page cache only once, however many handles
+// are open, and opening reads nothing upfront.
+class MappedDocumentFile
+{
+public:
+    // Null if the file cannot be mapped
+    static QSharedPointer<MappedDocumentFile> open(const QString &filePath);
+    ~MappedDocumentFile();
+
+    qint64 size() const;
+
+    // Loads document from the mapping, through a device owned by document
+    // that keeps the mapping alive. To be called before moving document to
+    // another thread. Returns whether document is Ready.
+    static bool load(QPdfDocument *document, const QSharedPointer<MappedDocumentFile> &mapping);
+
+private:
+    MappedDocumentFile() = default;
+    Q_DISABLE_COPY(MappedDocumentFile)
+
+    QFile m_file;
+    uchar *m_data = nullptr;
+    qint64 m_size = 0;
+};
+
+#endif // MAPPEDDOCUMENTFILE_H
@@ -0,0 +1,67 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "pagegeometryindex.h"
+#include <QSettings>
+#include <QtEndian>
+
+namespace {
+const int kValuesPerPage = 2;
+
+QString settingsKey(const QString &fileName, quint64 bytesCount)
+{
+    return fileName + QString::number(bytesCount);
+}
+} // namespace
+
+QVector<QSizeF> PageGeometryIndex::load(const QString &fileName, quint64 bytesCount, int pageCount)
+{
+    if (fileName.isEmpty() || !bytesCount || pageCount == 0)
+        return QVector<QSizeF>();
+    QSettings settings;
+    settings.beginGroup(QStringLiteral("geometrySettings"));
+    const QByteArray data = settings.value(settingsKey(fileName, bytesCount)).toByteArray();
+    const int entrySize = kValuesPerPage * int(sizeof(float));
+    if (pageCount < 0) // whatever was stored
+        pageCount = data.size() / entrySize;
+    if (!pageCount || data.size() != pageCount * entrySize)
+        return QVector<QSizeF>();
+
+    const uchar *values = reinterpret_cast<const uchar *>(data.constData());
+    QVector<QSizeF> pageSizes;
+    pageSizes.reserve(pageCount);
+    for (int i = 0; i < pageCount; ++i) {
+        const float width = qFromLittleEndian<float>(values + (kValuesPerPage * i) * sizeof(float));
+        const float height = qFromLittleEndian<float>(values + (kValuesPerPage * i + 1) * sizeof(float));
+        if (!(width > 0) || !(height > 0)) // corrupted
+            return QVector<QSizeF>();
+        pageSizes.append(QSizeF(width, height));
+    }
+    return pageSizes;
+}
+
+void PageGeometryIndex::store(const QString &fileName, quint64 bytesCount, const QVector<QSizeF> &pageSizes)
+{
+    if (fileName.isEmpty() || !bytesCount || pageSizes.isEmpty())
+        return;
+    QByteArray data(pageSizes.size() * kValuesPerPage * int(sizeof(float)), Qt::Uninitialized);
+    uchar *values = reinterpret_cast<uchar *>(data.data());
+    for (int i = 0; i < pageSizes.size(); ++i) {
+        qToLittleEndian<float>(float(pageSizes.at(i).width()), values + (kValuesPerPage * i) * sizeof(float));
+        qToLittleEndian<float>(float(pageSizes.at(i).height()), values + (kValuesPerPage * i + 1) * sizeof(float));
+    }
+    QSettings settings;
+    settings.beginGroup(QStringLiteral("geometrySettings"));
+    settings.setValue(settingsKey(fileName, bytesCount), data);
+}
@@ -0,0 +1,36 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef PAGEGEOMETRYINDEX_H
+#define PAGEGEOMETRYINDEX_H
+
+#include <QSizeF>
+#include <QString>
+#include <QVector>
+
+// Page sizes of the documents opened before, persisted with the other
+// per-document settings (group "geometrySettings", keyed by file name and
+// byte count like the crop and position settings), so that a reopened
+// document is laid out right away, without waiting for pdfium to parse it.
+// Each entry is an array of width, height pairs as little endian floats.
+// Safe to use from any thread.
+namespace PageGeometryIndex
+{
+// Empty if not stored, or stored for a different page count. A negative
+// pageCount accepts any, for when the document is not parsed yet.
+QVector<QSizeF> load(const QString &fileName, quint64 bytesCount, int pageCount);
+void store(const QString &fileName, quint64 bytesCount, const QVector<QSizeF> &pageSizes);
+}
+
+#endif // PAGEGEOMETRYINDEX_H
@@ -0,0 +1,75 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "pagegrayscale.h"
+
+namespace {
+// Channel spread below which a pixel counts as gray. Leaves room for
+// antialiasing and for the rounding of scanned documents.
+const int kColorTolerance = 8;
+
+inline bool isGray(int r, int g, int b)
+{
+    return qAbs(r - g) <= kColorTolerance
+            && qAbs(g - b) <= kColorTolerance
+            && qAbs(r - b) <= kColorTolerance;
+}
+
+inline uchar luma(int r, int g, int b)
+{
+    return uchar((r * 11 + g * 16 + b * 5) / 32); // as qGray()
+}
+} // namespace
+
+QImage toGrayscalePage(const QImage &page, bool onlyIfNoColor)
+{
+    if (page.isNull())
+        return QImage();
+    QImage src = page;
+    if (src.format() != QImage::Format_ARGB32
+            && src.format() != QImage::Format_ARGB32_Premultiplied
+            && src.format() != QImage::Format_RGB32) {
+        if (src.format() == QImage::Format_Grayscale8)
+            return src;
+        src = src.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    }
+    const bool premultiplied = src.format() != QImage::Format_ARGB32;
+
+    QImage dst(src.size(), QImage::Format_Grayscale8);
+    for (int y = 0; y < src.height(); ++y) {
+        const QRgb *in = reinterpret_cast<const QRgb *>(src.constScanLine(y));
+        uchar *out = dst.scanLine(y);
+        for (int x = 0; x < src.width(); ++x) {
+            const QRgb p = in[x];
+            const int a = qAlpha(p);
+            int r = qRed(p);
+            int g = qGreen(p);
+            int b = qBlue(p);
+            if (onlyIfNoColor && a && !isGray(r, g, b))
+                return QImage();
+            if (a == 255) {
+                out[x] = luma(r, g, b);
+                continue;
+            }
+            // Over white
+            if (!premultiplied) {
+                r = r * a / 255;
+                g = g * a / 255;
+                b = b * a / 255;
+            }
+            out[x] = uchar(qMin(255, luma(r, g, b) + 255 - a));
+        }
+    }
+    return dst;
+}
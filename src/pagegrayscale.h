@@ -0,0 +1,25 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef PAGEGRAYSCALE_H
+#define PAGEGRAYSCALE_H
+
+#include <QImage>
+
+// Converts a rendered page into an 8 bit luminance image (Format_Grayscale8),
+// composited over white, as pages are shown. With onlyIfNoColor, gives up
+// and returns a null image at the first pixel that is not a shade of gray.
+QImage toGrayscalePage(const QImage &page, bool onlyIfNoColor);
+
+#endif // PAGEGRAYSCALE_H
@@ -0,0 +1,593 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "pageoverview.h"
+#include "pdfimageprovider.h"
+#include "pagetexture.h"
+#include "qquickflickerlessimage.h"
+#include "tracelog.h"
+#include <QQuickWindow>
+#include <QSGGeometryNode>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QMutexLocker>
+#include <QtMath>
+#include <private/qquickwindow_p.h>
+#include <algorithm>
+
+namespace {
+// Within the minimum GL_MAX_TEXTURE_SIZE of GLES 2 hardware out there
+const int kAtlasSize = 2048;
+// Between thumbnails in the atlas, against bleeding with linear filtering
+const int kGutter = 1;
+// Taller pages are letterboxed
+const qreal kMaxAspect = 2.0;
+// Keeps the thumbnails of one atlas within 16 bit vertex indices
+const int kMinRasterWidth = 16;
+}
+
+// One atlas of thumbnails. Thumbnails arrive over time and are uploaded with
+// glTexSubImage2D at bind time, the atlas is never uploaded as a whole.
+class OverviewAtlasTexture : public QSGTexture
+{
+public:
+    OverviewAtlasTexture() = default;
+    ~OverviewAtlasTexture() override
+    {
+        if (m_textureId && QOpenGLContext::currentContext())
+            QOpenGLContext::currentContext()->functions()->glDeleteTextures(1, &m_textureId);
+    }
+
+    void addUpload(const QImage &image, const QPoint &position)
+    {
+        m_uploads.append(qMakePair(position, image));
+    }
+
+    int textureId() const override
+    {
+        return int(m_textureId);
+    }
+    QSize textureSize() const override
+    {
+        return QSize(kAtlasSize, kAtlasSize);
+    }
+    bool hasAlphaChannel() const override
+    {
+        return false;
+    }
+    bool hasMipmaps() const override
+    {
+        return false;
+    }
+
+    void bind() override
+    {
+        QOpenGLContext *ctx = QOpenGLContext::currentContext();
+        QOpenGLFunctions *f = ctx->functions();
+        const bool created = !m_textureId;
+        if (created)
+            f->glGenTextures(1, &m_textureId);
+        f->glBindTexture(GL_TEXTURE_2D, m_textureId);
+        updateBindOptions(created);
+        if (!created && m_uploads.isEmpty())
+            return;
+
+        TraceScope trace("scenegraph", "OverviewAtlasTexture::upload");
+        const QImage::Format format = PageTextureFactory::uploadFormat();
+        uint internalFormat;
+        uint externalFormat;
+        PageTexture::glFormats(ctx, format, internalFormat, externalFormat);
+        f->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        if (created) {
+            // White gutters, like the pages
+            QImage blank(kAtlasSize, kAtlasSize, format);
+            blank.fill(Qt::white);
+            f->glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, kAtlasSize, kAtlasSize, 0,
+                            externalFormat, GL_UNSIGNED_BYTE, blank.constBits());
+        }
+        for (const auto &u: qAsConst(m_uploads)) {
+            QImage image = u.second;
+            if (image.format() != format) // upload format refined meanwhile
+                image = image.convertToFormat(format);
+            f->glTexSubImage2D(GL_TEXTURE_2D, 0, u.first.x(), u.first.y(),
+                               image.width(), image.height(),
+                               externalFormat, GL_UNSIGNED_BYTE, image.constBits());
+        }
+        m_uploads.clear();
+    }
+
+private:
+    uint m_textureId = 0;
+    QVector<QPair<QPoint, QImage>> m_uploads;
+};
+
+// Scales a ThumbnailStore thumbnail to its slot
+class OverviewJob : public QRunnable
+{
+public:
+    OverviewJob(PageOverview &overview, int generation, int documentId, int page, QSize size)
+        : m_overview(overview), m_generation(generation)
+        , m_documentId(documentId), m_page(page), m_size(size)
+    {
+        setAutoDelete(false); // owned by the PageOverview
+    }
+
+    void run() override
+    {
+        TraceScope trace("render", "OverviewJob::run", QString::number(m_page));
+        QImage thumbnail;
+        if (!m_cancelled.loadAcquire()) {
+            // Letterboxed like the cells already
+            thumbnail = PdfImageProvider::instance().m_thumbnails.thumbnail(m_documentId, m_page);
+            if (!thumbnail.isNull() && thumbnail.size() != m_size)
+                thumbnail = thumbnail.scaled(m_size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            if (!thumbnail.isNull())
+                thumbnail = thumbnail.convertToFormat(PageTextureFactory::uploadFormat());
+        }
+        m_overview.thumbnailLoaded(this, thumbnail);
+    }
+
+    PageOverview &m_overview;
+    int m_generation;
+    int m_documentId;
+    int m_page;
+    QSize m_size;
+    QAtomicInt m_cancelled;
+};
+
+PageOverview::PageOverview(QQuickItem *parent) : QQuickItem(parent)
+{
+    setFlag(ItemHasContents, true);
+    connect(&PdfImageProvider::instance().m_thumbnails, &ThumbnailStore::thumbnailReady,
+            this, &PageOverview::onStoreThumbnailReady);
+}
+
+PageOverview::~PageOverview()
+{
+    // ~QQuickItem cannot reach releaseResources() anymore
+    if (window()) {
+        for (OverviewAtlasTexture *t: qAsConst(m_textures))
+            QQuickWindowQObjectCleanupJob::schedule(window(), t);
+        m_textures.clear();
+    }
+    cancelJobs();
+    QMutexLocker locker(&m_mutex);
+    while (!m_jobs.isEmpty())
+        m_jobsDone.wait(&m_mutex);
+}
+
+int PageOverview::documentId() const
+{
+    return m_documentId;
+}
+
+void PageOverview::setDocumentId(int documentId)
+{
+    if (documentId == m_documentId)
+        return;
+    m_documentId = documentId;
+    m_pageSizes.clear();
+    PdfManager *manager = PdfImageProvider::instance().m_manager;
+    if (manager && manager->isReady(documentId)) {
+        const int pageCount = manager->pageCount(documentId);
+        m_pageSizes.reserve(pageCount);
+        for (int i = 0; i < pageCount; ++i)
+            m_pageSizes.append(manager->pageSize(documentId, i));
+    }
+    emit documentIdChanged();
+    reload();
+}
+
+qreal PageOverview::thumbnailWidth() const
+{
+    return m_thumbnailWidth;
+}
+
+void PageOverview::setThumbnailWidth(qreal width)
+{
+    if (qFuzzyCompare(width, m_thumbnailWidth) || width <= 0)
+        return;
+    m_thumbnailWidth = width;
+    emit thumbnailWidthChanged();
+    relayout();
+}
+
+qreal PageOverview::spacing() const
+{
+    return m_spacing;
+}
+
+void PageOverview::setSpacing(qreal spacing)
+{
+    if (qFuzzyCompare(spacing, m_spacing))
+        return;
+    m_spacing = spacing;
+    emit spacingChanged();
+    relayout();
+}
+
+bool PageOverview::invert() const
+{
+    return m_invert;
+}
+
+void PageOverview::setInvert(bool invert)
+{
+    if (invert == m_invert)
+        return;
+    m_invert = invert;
+    emit invertChanged();
+    update();
+}
+
+int PageOverview::columns() const
+{
+    return m_columns;
+}
+
+QRectF PageOverview::viewport() const
+{
+    return m_viewport;
+}
+
+void PageOverview::setViewport(const QRectF &viewport)
+{
+    if (viewport == m_viewport)
+        return;
+    m_viewport = viewport;
+    emit viewportChanged();
+    updateWindow();
+}
+
+int PageOverview::pageAt(qreal x, qreal y) const
+{
+    // Rows are laid out top to bottom, cells left to right
+    for (int i = 0; i < m_cells.size(); ++i) {
+        const QRectF &c = m_cells.at(i);
+        if (c.top() > y)
+            break;
+        if (c.contains(x, y))
+            return i;
+    }
+    return -1;
+}
+
+QRectF PageOverview::pageRect(int page) const
+{
+    return m_cells.value(page);
+}
+
+qreal PageOverview::devicePixelRatio() const
+{
+    return (window()) ? window()->effectiveDevicePixelRatio() : 1.0;
+}
+
+QPoint PageOverview::slotPosition(int slot) const
+{
+    const int i = slot % m_slotsPerAtlas;
+    return QPoint((i % m_slotColumns) * (m_slotSize.width() + kGutter),
+                  (i / m_slotColumns) * (m_slotSize.height() + kGutter));
+}
+
+// Drops all thumbnails and loads them again, e.g. after a change of
+// resolution
+void PageOverview::reload()
+{
+    releaseThumbnails();
+    m_rasterWidth = 0;
+    relayout();
+}
+
+void PageOverview::releaseThumbnails()
+{
+    cancelJobs();
+    ++m_generation;
+    m_thumbnails = QVector<Thumbnail>(m_pageSizes.size());
+    m_windowFirst = 0;
+    m_windowLast = -1;
+    m_uploads.clear();
+    m_resetTextures = true;
+    m_atlasCount = 0;
+    m_slotCount = 0;
+    m_freeSlots.clear();
+    update();
+}
+
+void PageOverview::relayout()
+{
+    const qreal w = width();
+    const int columns = qMax(1, int((w + m_spacing) / (m_thumbnailWidth + m_spacing)));
+    const qreal left = qMax(0.0, (w - columns * m_thumbnailWidth - (columns - 1) * m_spacing) * 0.5);
+    m_cells.resize(m_pageSizes.size());
+    qreal y = m_spacing;
+    for (int row = 0; row * columns < m_pageSizes.size(); ++row) {
+        qreal rowHeight = 0;
+        for (int c = 0; c < columns && row * columns + c < m_pageSizes.size(); ++c) {
+            const int i = row * columns + c;
+            const QSizeF &ps = m_pageSizes.at(i);
+            const qreal aspect = (ps.width() > 0) ? qMin(kMaxAspect, ps.height() / ps.width()) : 1.0;
+            m_cells[i] = QRectF(left + c * (m_thumbnailWidth + m_spacing), y,
+                                m_thumbnailWidth, m_thumbnailWidth * aspect);
+            rowHeight = qMax(rowHeight, m_cells.at(i).height());
+        }
+        y += rowHeight + m_spacing;
+    }
+    setImplicitHeight(y);
+    if (columns != m_columns) {
+        m_columns = columns;
+        emit layoutChanged();
+    }
+
+    // Stored thumbnails are scaled down to the resolution of the cells, never up
+    const int rasterWidth = qBound(kMinRasterWidth, qCeil(m_thumbnailWidth * devicePixelRatio()),
+                                   int(ThumbnailStore::Width));
+    if (rasterWidth != m_rasterWidth && window()) {
+        if (m_rasterWidth)
+            releaseThumbnails();
+        m_rasterWidth = rasterWidth;
+        m_slotSize = QSize(rasterWidth, qCeil(rasterWidth * kMaxAspect));
+        m_slotColumns = (kAtlasSize + kGutter) / (m_slotSize.width() + kGutter);
+        m_slotsPerAtlas = m_slotColumns * ((kAtlasSize + kGutter) / (m_slotSize.height() + kGutter));
+    }
+    updateWindow();
+    update();
+}
+
+void PageOverview::updateWindow()
+{
+    if (!m_rasterWidth || !window() || !isVisible() || m_cells.isEmpty())
+        return;
+    // A screen above and below the one shown. Until a viewport is set, the
+    // first screen
+    QRectF area = m_viewport;
+    if (area.isEmpty())
+        area = QRectF(0, 0, width(), window()->height());
+    area.adjust(0, -area.height(), 0, area.height());
+
+    // Cells are sorted by top, and at most kMaxAspect times as tall as wide
+    const qreal firstTop = area.top() - m_thumbnailWidth * kMaxAspect;
+    const int first = int(std::lower_bound(m_cells.cbegin(), m_cells.cend(), firstTop,
+                                           [](const QRectF &c, qreal y) { return c.top() < y; })
+                          - m_cells.cbegin());
+    int last = first - 1;
+    while (last + 1 < m_cells.size() && m_cells.at(last + 1).top() <= area.bottom())
+        ++last;
+
+    for (int i = m_windowFirst; i <= m_windowLast; ++i) {
+        if (i < first || i > last)
+            evict(i);
+    }
+    m_windowFirst = first;
+    m_windowLast = last;
+    ThumbnailStore &store = PdfImageProvider::instance().m_thumbnails;
+    for (int i = first; i <= last; ++i) {
+        if (store.contains(m_documentId, i))
+            load(i);
+    }
+}
+
+void PageOverview::load(int page)
+{
+    Thumbnail &t = m_thumbnails[page];
+    if (t.slot >= 0 || t.pending)
+        return;
+    t.pending = true;
+    const QRectF &cell = m_cells.at(page);
+    const QSize size(m_slotSize.width(),
+                     qMin(m_slotSize.height(), qMax(1, qRound(m_slotSize.width() * cell.height() / cell.width()))));
+    OverviewJob *job = new OverviewJob(*this, m_generation, m_documentId, page, size);
+    QMutexLocker locker(&m_mutex);
+    m_jobs.append(job);
+    QThreadPool::globalInstance()->start(job);
+}
+
+void PageOverview::evict(int page)
+{
+    Thumbnail &t = m_thumbnails[page];
+    if (t.pending) {
+        QMutexLocker locker(&m_mutex);
+        for (int i = 0; i < m_jobs.size(); ++i) {
+            OverviewJob *job = m_jobs.at(i);
+            if (job->m_page != page || job->m_generation != m_generation)
+                continue;
+            job->m_cancelled.storeRelease(1);
+            if (QThreadPool::globalInstance()->tryTake(job)) {
+                m_jobs.remove(i);
+                delete job;
+            }
+            break;
+        }
+        t.pending = false;
+    }
+    if (t.slot >= 0) {
+        m_freeSlots.append(t.slot);
+        t.slot = -1;
+        update();
+    }
+}
+
+void PageOverview::cancelJobs()
+{
+    QMutexLocker locker(&m_mutex);
+    for (int i = m_jobs.size() - 1; i >= 0; --i) {
+        OverviewJob *job = m_jobs.at(i);
+        job->m_cancelled.storeRelease(1);
+        if (QThreadPool::globalInstance()->tryTake(job)) {
+            m_jobs.remove(i);
+            delete job;
+        }
+    }
+}
+
+void PageOverview::thumbnailLoaded(OverviewJob *job, const QImage &thumbnail)
+{
+    QMutexLocker locker(&m_mutex);
+    m_jobs.removeOne(job);
+    if (!job->m_cancelled.loadAcquire() && !thumbnail.isNull()) {
+        QMetaObject::invokeMethod(this, "onThumbnailLoaded", Qt::QueuedConnection,
+                                  Q_ARG(int, job->m_generation),
+                                  Q_ARG(int, job->m_page),
+                                  Q_ARG(QImage, thumbnail));
+    }
+    delete job;
+    if (m_jobs.isEmpty())
+        m_jobsDone.wakeAll();
+}
+
+void PageOverview::onThumbnailLoaded(int generation, int page, const QImage &thumbnail)
+{
+    if (generation != m_generation || page >= m_thumbnails.size())
+        return;
+    Thumbnail &t = m_thumbnails[page];
+    if (!t.pending) // evicted meanwhile
+        return;
+    t.pending = false;
+    const int slot = (m_freeSlots.isEmpty()) ? m_slotCount++ : m_freeSlots.takeLast();
+    m_atlasCount = qMax(m_atlasCount, slot / m_slotsPerAtlas + 1);
+    t.slot = slot;
+    t.size = thumbnail.size().boundedTo(m_slotSize);
+    m_uploads.append({ slot / m_slotsPerAtlas, slotPosition(slot),
+                       thumbnail.copy(QRect(QPoint(), t.size)) });
+    update();
+}
+
+void PageOverview::onStoreThumbnailReady(int documentId, int page)
+{
+    if (documentId != m_documentId || page < m_windowFirst || page > m_windowLast)
+        return;
+    load(page);
+}
+
+QSGNode *PageOverview::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *)
+{
+    TraceScope trace("scenegraph", "PageOverview::updatePaintNode");
+    QSGNode *root = oldNode;
+    if (!root)
+        root = new QSGNode;
+
+    if (m_resetTextures) {
+        qDeleteAll(m_textures);
+        m_textures.clear();
+        m_resetTextures = false;
+    }
+    while (m_textures.size() < m_atlasCount) {
+        OverviewAtlasTexture *t = new OverviewAtlasTexture;
+        t->setFiltering(QSGTexture::Linear);
+        m_textures.append(t);
+    }
+    for (const Upload &u: qAsConst(m_uploads))
+        m_textures.at(u.atlas)->addUpload(u.image, u.position);
+    m_uploads.clear();
+
+    // One node per atlas
+    while (root->childCount() > m_atlasCount) {
+        QSGNode *child = root->lastChild();
+        root->removeChildNode(child);
+        delete child;
+    }
+    while (root->childCount() < m_atlasCount) {
+        QSGGeometryNode *node = new QSGGeometryNode;
+        QSGGeometry *geometry = new QSGGeometry(QSGGeometry::defaultAttributes_TexturedPoint2D(),
+                                                0, 0, QSGGeometry::UnsignedShortType);
+        geometry->setDrawingMode(QSGGeometry::DrawTriangles);
+        node->setGeometry(geometry);
+        node->setMaterial(new QSGCoolTextureMaterial);
+        node->setFlags(QSGNode::OwnsGeometry | QSGNode::OwnsMaterial);
+        root->appendChildNode(node);
+    }
+
+    // Loaded thumbnails are all within the window
+    QVector<int> quads(m_atlasCount, 0);
+    for (int i = m_windowFirst; i <= m_windowLast; ++i) {
+        const Thumbnail &t = m_thumbnails.at(i);
+        if (t.slot >= 0)
+            ++quads[t.slot / m_slotsPerAtlas];
+    }
+
+    QSGNode *child = root->firstChild();
+    for (int a = 0; a < m_atlasCount; ++a, child = child->nextSibling()) {
+        QSGGeometryNode *node = static_cast<QSGGeometryNode *>(child);
+        QSGGeometry *geometry = node->geometry();
+        geometry->allocate(quads.at(a) * 4, quads.at(a) * 6);
+        QSGGeometry::TexturedPoint2D *v = geometry->vertexDataAsTexturedPoint2D();
+        quint16 *idx = geometry->indexDataAsUShort();
+        int q = 0;
+        for (int i = m_windowFirst; i <= m_windowLast; ++i) {
+            const Thumbnail &t = m_thumbnails.at(i);
+            if (t.slot < 0 || t.slot / m_slotsPerAtlas != a)
+                continue;
+            const QRectF &r = m_cells.at(i);
+            const QPoint position = slotPosition(t.slot);
+            const QRectF tr(qreal(position.x()) / kAtlasSize,
+                            qreal(position.y()) / kAtlasSize,
+                            qreal(t.size.width()) / kAtlasSize,
+                            qreal(t.size.height()) / kAtlasSize);
+            v[q * 4 + 0].set(r.left(), r.top(), tr.left(), tr.top());
+            v[q * 4 + 1].set(r.right(), r.top(), tr.right(), tr.top());
+            v[q * 4 + 2].set(r.left(), r.bottom(), tr.left(), tr.bottom());
+            v[q * 4 + 3].set(r.right(), r.bottom(), tr.right(), tr.bottom());
+            const quint16 base = quint16(q * 4);
+            idx[q * 6 + 0] = base;
+            idx[q * 6 + 1] = base + 1;
+            idx[q * 6 + 2] = base + 2;
+            idx[q * 6 + 3] = base + 1;
+            idx[q * 6 + 4] = base + 3;
+            idx[q * 6 + 5] = base + 2;
+            ++q;
+        }
+        QSGCoolTextureMaterial *material = static_cast<QSGCoolTextureMaterial *>(node->material());
+        material->setTexture(m_textures.at(a));
+        material->setFiltering(QSGTexture::Linear);
+        material->setFlag(QSGMaterial::Blending, false); // opaque atlases
+        material->uniforms.invert = m_invert;
+        node->markDirty(QSGNode::DirtyGeometry | QSGNode::DirtyMaterial);
+    }
+    return root;
+}
+
+void PageOverview::geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry)
+{
+    QQuickItem::geometryChanged(newGeometry, oldGeometry);
+    if (!qFuzzyCompare(newGeometry.width(), oldGeometry.width()))
+        relayout();
+}
+
+void PageOverview::itemChange(ItemChange change, const ItemChangeData &value)
+{
+    QQuickItem::itemChange(change, value);
+    if (change == ItemDevicePixelRatioHasChanged || (change == ItemSceneChange && value.window))
+        relayout();
+    else if (change == ItemVisibleHasChanged && !value.boolValue)
+        releaseThumbnails(); // atlases go on the next sync
+    else if (change == ItemVisibleHasChanged)
+        updateWindow();
+}
+
+void PageOverview::releaseResources()
+{
+    for (OverviewAtlasTexture *t: qAsConst(m_textures))
+        QQuickWindowQObjectCleanupJob::schedule(window(), t);
+    m_textures.clear();
+    // Back in a window, the atlases have to be filled again
+    QMetaObject::invokeMethod(this, "reload", Qt::QueuedConnection);
+}
+
+void PageOverview::invalidateSceneGraph()
+{
+    qDeleteAll(m_textures);
+    m_textures.clear();
+    QMetaObject::invokeMethod(this, "reload", Qt::QueuedConnection);
+}
@@ -0,0 +1,156 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef PAGEOVERVIEW_H
+#define PAGEOVERVIEW_H
+
+#include <QQuickItem>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QImage>
+#include <QRectF>
+
+class OverviewJob;
+class OverviewAtlasTexture;
+
+// Grid of thumbnails of all the pages of a document, meant to be placed in a
+// Flickable (its implicitHeight is the height of the grid).
+// Thumbnails come from the ThumbnailStore, scaled, and are packed into shared
+// texture atlases as they arrive, so that the whole grid is drawn by one
+// geometry node per atlas, using QSGCoolTextureMaterial, instead of one
+// image node per page.
+// Only the rows within a screen of the viewport are loaded: atlases are
+// divided into fixed size slots, one per thumbnail, reused as the viewport
+// moves. Pages without a stored thumbnail yet are loaded once the
+// ThumbnailStore generates it. Everything is released when the item is
+// hidden.
+class PageOverview : public QQuickItem
+{
+    Q_OBJECT
+    Q_PROPERTY(int documentId READ documentId WRITE setDocumentId NOTIFY documentIdChanged)
+    // In item coordinates. Thumbnails are loaded at this width times the
+    // device pixel ratio, at most ThumbnailStore::Width
+    Q_PROPERTY(qreal thumbnailWidth READ thumbnailWidth WRITE setThumbnailWidth NOTIFY thumbnailWidthChanged)
+    Q_PROPERTY(qreal spacing READ spacing WRITE setSpacing NOTIFY spacingChanged)
+    Q_PROPERTY(bool invert READ invert WRITE setInvert NOTIFY invertChanged)
+    Q_PROPERTY(int columns READ columns NOTIFY layoutChanged)
+    // The part of the item on screen, in item coordinates
+    Q_PROPERTY(QRectF viewport READ viewport WRITE setViewport NOTIFY viewportChanged)
+public:
+    PageOverview(QQuickItem *parent = nullptr);
+    ~PageOverview() override;
+
+    int documentId() const;
+    void setDocumentId(int documentId);
+    qreal thumbnailWidth() const;
+    void setThumbnailWidth(qreal width);
+    qreal spacing() const;
+    void setSpacing(qreal spacing);
+    bool invert() const;
+    void setInvert(bool invert);
+    int columns() const;
+    QRectF viewport() const;
+    void setViewport(const QRectF &viewport);
+
+    // -1 if (x, y) is not on a thumbnail
+    Q_INVOKABLE int pageAt(qreal x, qreal y) const;
+    Q_INVOKABLE QRectF pageRect(int page) const;
+
+signals:
+    void documentIdChanged();
+    void thumbnailWidthChanged();
+    void spacingChanged();
+    void invertChanged();
+    void layoutChanged();
+    void viewportChanged();
+
+public slots:
+    void reload();
+
+protected:
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *) override;
+    void geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry) override;
+    void itemChange(ItemChange change, const ItemChangeData &value) override;
+    void releaseResources() override;
+
+private slots:
+    void invalidateSceneGraph(); // render thread
+    void onThumbnailLoaded(int generation, int page, const QImage &thumbnail);
+    void onStoreThumbnailReady(int documentId, int page);
+
+private:
+    friend class OverviewJob;
+    // Worker threads
+    void thumbnailLoaded(OverviewJob *job, const QImage &thumbnail);
+
+    void relayout();
+    // Loads the thumbnails near the viewport, evicts the others
+    void updateWindow();
+    // Drops all thumbnails and atlases
+    void releaseThumbnails();
+    void load(int page);
+    void evict(int page);
+    void cancelJobs();
+    qreal devicePixelRatio() const;
+    QPoint slotPosition(int slot) const;
+
+    struct Upload
+    {
+        int atlas;
+        QPoint position;
+        QImage image;
+    };
+    struct Thumbnail
+    {
+        int slot = -1; // not loaded
+        bool pending = false; // being loaded
+        QSize size; // in the slot
+    };
+
+    int m_documentId = -1;
+    qreal m_thumbnailWidth = 120;
+    qreal m_spacing = 8;
+    bool m_invert = false;
+    int m_columns = 1;
+    QRectF m_viewport;
+
+    QVector<QSizeF> m_pageSizes; // points
+    QVector<QRectF> m_cells; // item coordinates
+    QVector<Thumbnail> m_thumbnails;
+    int m_rasterWidth = 0; // of the loaded thumbnails
+    // Pages loaded or pending, all within this range
+    int m_windowFirst = 0;
+    int m_windowLast = -1;
+
+    // Fixed size slots of the atlases
+    QSize m_slotSize;
+    int m_slotColumns = 1;
+    int m_slotsPerAtlas = 1;
+    int m_slotCount = 0; // ever handed out, since the last release
+    QVector<int> m_freeSlots;
+    int m_atlasCount = 0;
+
+    // Handed to the render thread on sync
+    QVector<Upload> m_uploads;
+    bool m_resetTextures = false;
+    QVector<OverviewAtlasTexture *> m_textures; // render thread
+
+    int m_generation = 0;
+    QMutex m_mutex;
+    QWaitCondition m_jobsDone;
+    QVector<OverviewJob *> m_jobs; // queued or running
+};
+
+#endif // PAGEOVERVIEW_H
@@ -0,0 +1,173 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "pageprefetcher.h"
+#include "pdfimageprovider.h"
+#include <QUrl>
+#include <QGuiApplication>
+#include <QQuickWindow>
+#include <QtMath>
+
+namespace {
+// Share of the render cache budget prefetched pages may take
+constexpr qreal kBudgetShare = 0.25;
+}
+
+PagePrefetcher::PagePrefetcher(QObject *parent) : QObject(parent)
+{
+    connect(this, &PagePrefetcher::enabledChanged, this, &PagePrefetcher::update);
+}
+
+PagePrefetcher::~PagePrefetcher()
+{
+    clear();
+}
+
+QQuickItem *PagePrefetcher::target() const
+{
+    return m_target;
+}
+
+void PagePrefetcher::setTarget(QQuickItem *target)
+{
+    if (target == m_target)
+        return;
+    if (m_target)
+        m_target->disconnect(this);
+    m_target = target;
+    if (m_target) {
+        // Any Flickable. The ListView also provides indexAt()
+        connect(m_target, SIGNAL(contentYChanged()), this, SLOT(update()));
+        connect(m_target, SIGNAL(verticalVelocityChanged()), this, SLOT(update()));
+        connect(m_target, SIGNAL(contentHeightChanged()), this, SLOT(update()));
+        connect(m_target, SIGNAL(heightChanged()), this, SLOT(update()));
+        m_lastContentY = m_target->property("contentY").toReal();
+    }
+    emit targetChanged();
+    update();
+}
+
+QJSValue PagePrefetcher::request() const
+{
+    return m_request;
+}
+
+void PagePrefetcher::setRequest(const QJSValue &request)
+{
+    m_request = request;
+    emit requestChanged();
+    update();
+}
+
+int PagePrefetcher::count() const
+{
+    return m_count;
+}
+
+void PagePrefetcher::setCount(int count)
+{
+    if (count == m_count)
+        return;
+    m_count = count;
+    emit countChanged();
+    update();
+}
+
+int PagePrefetcher::indexAt(qreal x, qreal y) const
+{
+    int res = -1;
+    QMetaObject::invokeMethod(m_target, "indexAt",
+                              Q_RETURN_ARG(int, res),
+                              Q_ARG(qreal, x),
+                              Q_ARG(qreal, y));
+    return res;
+}
+
+void PagePrefetcher::update()
+{
+    if (!m_enabled || !m_target || !m_request.isCallable() || m_count <= 0) {
+        clear();
+        return;
+    }
+
+    const qreal contentX = m_target->property("contentX").toReal();
+    const qreal contentY = m_target->property("contentY").toReal();
+    const qreal contentHeight = m_target->property("contentHeight").toReal();
+    const qreal height = m_target->height();
+    // The direction comes from the movement itself, the magnitude from the
+    // (smoothed) velocity of the flickable
+    const qreal velocity = qAbs(m_target->property("verticalVelocity").toReal());
+    if (contentY != m_lastContentY)
+        m_direction = (contentY > m_lastContentY) ? 1 : -1;
+    m_lastContentY = contentY;
+
+    int first = indexAt(contentX, contentY);
+    if (first < 0) // on a page delimiter
+        first = indexAt(contentX, contentY + 2);
+    int last = indexAt(contentX, contentY + height - 1);
+    if (last < 0)
+        last = (first < 0) ? -1 : m_count - 1;
+    if (first < 0)
+        first = last;
+    if (first < 0)
+        return;
+
+    QVector<int> pages;
+    if (qFuzzyIsNull(velocity)) {
+        // At rest, one page on each side
+        pages << last + 1 << first - 1;
+    } else {
+        const qreal pageHeight = contentHeight / m_count; // ListView estimate
+        int ahead = (pageHeight > 0) ? qCeil(velocity * m_lookahead / pageHeight) : 1;
+        ahead = qBound(1, ahead, m_maximumPages);
+        for (int i = 1; i <= ahead; ++i)
+            pages << ((m_direction > 0) ? last + i : first - i);
+    }
+
+    const qint64 budget = PdfImageProvider::instance().m_cache.budget() * kBudgetShare;
+    qint64 bytes = 0;
+    // Delegates request sourceSize scaled by the device pixel ratio, see
+    // QQuickImageBase::load: so must the prefetches, for the cache keys to match
+    const qreal dpr = (m_target->window()) ? m_target->window()->effectiveDevicePixelRatio()
+                                           : qApp->devicePixelRatio();
+    QVector<QPair<QString, QSize>> requests;
+    for (int page: qAsConst(pages)) {
+        if (page < 0 || page >= m_count)
+            continue;
+        const QJSValue r = m_request.call({ QJSValue(page) });
+        const QUrl source(r.property(QStringLiteral("source")).toString());
+        const QSize size = r.property(QStringLiteral("sourceSize")).toVariant().toSizeF().toSize() * dpr;
+        if (source.scheme() != QLatin1String("image") || size.isEmpty())
+            continue;
+        bytes += qint64(size.width()) * size.height() * 4;
+        if (bytes > budget)
+            break;
+        // Same id QQuickPixmap passes to the image provider
+        requests.append(qMakePair(source.toString(QUrl::RemoveScheme | QUrl::RemoveAuthority).mid(1),
+                                  size));
+    }
+
+    if (requests == m_queued)
+        return;
+    m_queued = requests;
+    PdfImageProvider::instance().prefetch(m_queued);
+}
+
+void PagePrefetcher::clear()
+{
+    if (m_queued.isEmpty())
+        return;
+    m_queued.clear();
+    PdfImageProvider::instance().prefetch(m_queued);
+}
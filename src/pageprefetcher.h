@@ -0,0 +1,82 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef PAGEPREFETCHER_H
+#define PAGEPREFETCHER_H
+
+#include <QObject>
+#include <QPointer>
+#include <QQuickItem>
+#include <QJSValue>
+#include <QVector>
+#include <QPair>
+#include <QSize>
+
+// Renders ahead of a flicking ListView of pages, into the render cache, so
+// that pages are ready by the time their delegates get created.
+// How far ahead it reaches grows with the flick velocity, and the prefetched
+// pages are kept within a share of the render cache budget, not to evict
+// the visible ones.
+// request is a function(index) returning { source, sourceSize }: the image
+// the delegate of that page is going to request.
+class PagePrefetcher : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QQuickItem *target READ target WRITE setTarget NOTIFY targetChanged)
+    Q_PROPERTY(QJSValue request READ request WRITE setRequest NOTIFY requestChanged)
+    Q_PROPERTY(int count READ count WRITE setCount NOTIFY countChanged)
+    Q_PROPERTY(bool enabled MEMBER m_enabled NOTIFY enabledChanged)
+    // Seconds of scrolling, at the current velocity, to render ahead
+    Q_PROPERTY(qreal lookahead MEMBER m_lookahead NOTIFY lookaheadChanged)
+    Q_PROPERTY(int maximumPages MEMBER m_maximumPages NOTIFY maximumPagesChanged)
+public:
+    PagePrefetcher(QObject *parent = nullptr);
+    ~PagePrefetcher();
+
+    QQuickItem *target() const;
+    void setTarget(QQuickItem *target);
+
+    QJSValue request() const;
+    void setRequest(const QJSValue &request);
+
+    int count() const;
+    void setCount(int count);
+
+public slots:
+    void update();
+    void clear();
+
+signals:
+    void targetChanged();
+    void requestChanged();
+    void countChanged();
+    void enabledChanged();
+    void lookaheadChanged();
+    void maximumPagesChanged();
+
+protected:
+    int indexAt(qreal x, qreal y) const;
+
+    QPointer<QQuickItem> m_target;
+    QJSValue m_request;
+    int m_count = 0;
+    bool m_enabled = true;
+    qreal m_lookahead = 0.5;
+    int m_maximumPages = 8;
+    qreal m_lastContentY = 0;
+    int m_direction = 1;
+    QVector<QPair<QString, QSize>> m_queued;
+};
+
+#endif // PAGEPREFETCHER_H
@@ -0,0 +1,130 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "pagerendercache.h"
+#include <QMutexLocker>
+#include <limits>
+
+static int costOf(const QImage &image)
+{
+    return int((image.sizeInBytes() + 1023) / 1024);
+}
+
+PageRenderCache::PageRenderCache(qint64 budget)
+{
+    setBudget(budget);
+}
+
+bool PageRenderCache::find(const PageRenderKey &key, QImage &image)
+{
+    QMutexLocker locker(&m_mutex);
+    QImage *cached = m_cache.object(key); // also marks it as most recently used
+    if (!cached)
+        return false;
+    image = *cached;
+    return true;
+}
+
+bool PageRenderCache::findAnySize(int documentId, int page, const QVector4D &margins, int colorMode,
+                                  QImage &image)
+{
+    PageRenderKey key;
+    key.documentId = documentId;
+    key.page = page;
+    key.margins = margins;
+    key.colorMode = colorMode;
+
+    QMutexLocker locker(&m_mutex);
+    auto it = m_sizes.find(key);
+    if (it == m_sizes.end())
+        return false;
+    QVector<QSize> &sizes = it.value();
+    QImage *best = nullptr;
+    for (int i = sizes.size() - 1; i >= 0; --i) {
+        key.size = sizes.at(i);
+        QImage *cached = m_cache.object(key);
+        if (!cached) {
+            sizes.remove(i); // evicted
+            continue;
+        }
+        if (!best || cached->width() > best->width())
+            best = cached;
+    }
+    if (sizes.isEmpty())
+        m_sizes.erase(it);
+    if (!best)
+        return false;
+    image = *best;
+    return true;
+}
+
+void PageRenderCache::insert(const PageRenderKey &key, const QImage &image)
+{
+    if (image.isNull())
+        return;
+    QMutexLocker locker(&m_mutex);
+    m_cache.insert(key, new QImage(image), costOf(image));
+    if (key.tile.isValid() || !m_cache.contains(key)) // tiles, or over budget
+        return;
+    QVector<QSize> &sizes = m_sizes[sizesKey(key)];
+    PageRenderKey k = key;
+    for (int i = sizes.size() - 1; i >= 0; --i) {
+        k.size = sizes.at(i);
+        if (sizes.at(i) == key.size || !m_cache.contains(k))
+            sizes.remove(i);
+    }
+    sizes.append(key.size);
+}
+
+void PageRenderCache::removeDocument(int documentId)
+{
+    QMutexLocker locker(&m_mutex);
+    const QList<PageRenderKey> keys = m_cache.keys();
+    for (const PageRenderKey &k: keys) {
+        if (k.documentId == documentId)
+            m_cache.remove(k);
+    }
+    for (auto it = m_sizes.begin(); it != m_sizes.end();) {
+        if (it.key().documentId == documentId)
+            it = m_sizes.erase(it);
+        else
+            ++it;
+    }
+}
+
+PageRenderKey PageRenderCache::sizesKey(const PageRenderKey &key)
+{
+    PageRenderKey k = key;
+    k.size = QSize();
+    k.tile = QRect();
+    return k;
+}
+
+qint64 PageRenderCache::budget() const
+{
+    QMutexLocker locker(&m_mutex);
+    return qint64(m_cache.maxCost()) * 1024;
+}
+
+void PageRenderCache::setBudget(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.setMaxCost(int(qBound<qint64>(0, bytes / 1024, std::numeric_limits<int>::max())));
+}
+
+qint64 PageRenderCache::size() const
+{
+    QMutexLocker locker(&m_mutex);
+    return qint64(m_cache.totalCost()) * 1024;
+}
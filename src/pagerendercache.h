@@ -0,0 +1,98 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef PAGERENDERCACHE_H
+#define PAGERENDERCACHE_H
+
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QRect>
+#include <QSize>
+#include <QVector4D>
+#include <QHash>
+#include <QVector>
+
+// Identifies one rendered image, as produced by AsyncImageResponse.
+// size is the requested (uncropped) raster size, tile is empty for whole pages.
+// colorMode is a PdfManager::ColorMode.
+struct PageRenderKey
+{
+    int documentId = -1;
+    int page = -1;
+    QSize size;
+    QVector4D margins;
+    QRect tile;
+    int colorMode = 0;
+
+    bool operator==(const PageRenderKey &o) const
+    {
+        return documentId == o.documentId
+                && page == o.page
+                && size == o.size
+                && margins == o.margins
+                && tile == o.tile
+                && colorMode == o.colorMode;
+    }
+};
+
+inline uint qHash(const PageRenderKey &k, uint seed = 0)
+{
+    uint h = qHash(k.documentId, seed);
+    h = h * 31 + qHash(k.page, seed);
+    h = h * 31 + qHash(k.size.width(), seed);
+    h = h * 31 + qHash(k.size.height(), seed);
+    h = h * 31 + qHash(k.margins.x(), seed);
+    h = h * 31 + qHash(k.margins.y(), seed);
+    h = h * 31 + qHash(k.margins.z(), seed);
+    h = h * 31 + qHash(k.margins.w(), seed);
+    h = h * 31 + qHash(k.tile.x(), seed);
+    h = h * 31 + qHash(k.tile.y(), seed);
+    h = h * 31 + qHash(k.tile.width(), seed);
+    h = h * 31 + qHash(k.tile.height(), seed);
+    h = h * 31 + qHash(k.colorMode, seed);
+    return h;
+}
+
+// Thread safe LRU cache of rendered pages, bounded by the total size in bytes
+// of the cached images.
+class PageRenderCache
+{
+public:
+    PageRenderCache(qint64 budget);
+
+    bool find(const PageRenderKey &key, QImage &image);
+    // Largest cached whole-page render of the page with these margins and
+    // color mode, of any size
+    bool findAnySize(int documentId, int page, const QVector4D &margins, int colorMode,
+                     QImage &image);
+    void insert(const PageRenderKey &key, const QImage &image);
+    void removeDocument(int documentId);
+
+    qint64 budget() const;
+    void setBudget(qint64 bytes);
+    qint64 size() const;
+
+private:
+    // The sizes of whole-page renders, per page, margins and color mode
+    static PageRenderKey sizesKey(const PageRenderKey &key);
+
+    mutable QMutex m_mutex;
+    QCache<PageRenderKey, QImage> m_cache; // cost in KiB, to stay within int
+    // Index for findAnySize. QCache evicts silently, so entries can be stale
+    // and are pruned when met
+    QHash<PageRenderKey, QVector<QSize>> m_sizes;
+};
+
+#endif // PAGERENDERCACHE_H
@@ -0,0 +1,202 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "pagetexture.h"
+#include "tracelog.h"
+#include <QQuickWindow>
+#include <QSGRendererInterface>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QAtomicInt>
+
+#ifndef GL_BGRA
+#define GL_BGRA 0x80E1
+#endif
+#ifndef GL_RED
+#define GL_RED 0x1903
+#endif
+#ifndef GL_R8
+#define GL_R8 0x8229
+#endif
+
+namespace {
+QImage::Format initialUploadFormat()
+{
+    return (QOpenGLContext::openGLModuleType() == QOpenGLContext::LibGL)
+            ? QImage::Format_ARGB32_Premultiplied
+            : QImage::Format_RGBA8888_Premultiplied;
+}
+
+QAtomicInt s_uploadFormat(QImage::Format_Invalid); // until known
+
+// GL_RED textures need GLES 3 or desktop GL 3, older contexts only have
+// GL_LUMINANCE. Either way the page ends up in the red channel.
+bool supportsRed(QOpenGLContext *ctx)
+{
+    return ctx->format().majorVersion() >= 3;
+}
+
+bool supportsBgra(QOpenGLContext *ctx)
+{
+    return !ctx->isOpenGLES()
+            || ctx->hasExtension(QByteArrayLiteral("GL_EXT_texture_format_BGRA8888"))
+            || ctx->hasExtension(QByteArrayLiteral("GL_IMG_texture_format_BGRA8888"));
+}
+} // namespace
+
+PageTextureFactory::PageTextureFactory(const QImage &image) : m_image(image)
+{
+}
+
+QSGTexture *PageTextureFactory::createTexture(QQuickWindow *window) const
+{
+    if (window->rendererInterface()->graphicsApi() != QSGRendererInterface::OpenGL)
+        return window->createTextureFromImage(m_image);
+    QOpenGLContext *ctx = QOpenGLContext::currentContext();
+    if (ctx) {
+        s_uploadFormat.storeRelaxed((supportsBgra(ctx))
+                                    ? QImage::Format_ARGB32_Premultiplied
+                                    : QImage::Format_RGBA8888_Premultiplied);
+    }
+    return new PageTexture(m_image);
+}
+
+QSize PageTextureFactory::textureSize() const
+{
+    return m_image.size();
+}
+
+int PageTextureFactory::textureByteCount() const
+{
+    return m_image.sizeInBytes();
+}
+
+QImage PageTextureFactory::image() const
+{
+    return m_image;
+}
+
+QImage::Format PageTextureFactory::uploadFormat()
+{
+    const QImage::Format format = QImage::Format(s_uploadFormat.loadRelaxed());
+    return (format == QImage::Format_Invalid) ? initialUploadFormat() : format;
+}
+
+QImage PageTextureFactory::prepare(const QImage &image)
+{
+    // Grayscale pages are uploaded as single channel textures
+    if (image.isNull() || image.format() == uploadFormat()
+            || image.format() == QImage::Format_Grayscale8)
+        return image;
+    return image.convertToFormat(uploadFormat());
+}
+
+PageTexture::PageTexture(const QImage &image)
+    : m_image(image)
+    , m_size(image.size())
+    , m_hasAlpha(image.hasAlphaChannel())
+    , m_singleChannel(image.format() == QImage::Format_Grayscale8)
+{
+}
+
+PageTexture::~PageTexture()
+{
+    if (m_textureId && QOpenGLContext::currentContext())
+        QOpenGLContext::currentContext()->functions()->glDeleteTextures(1, &m_textureId);
+}
+
+int PageTexture::textureId() const
+{
+    return int(m_textureId);
+}
+
+QSize PageTexture::textureSize() const
+{
+    return m_size;
+}
+
+bool PageTexture::hasAlphaChannel() const
+{
+    return m_hasAlpha;
+}
+
+bool PageTexture::isSingleChannel() const
+{
+    return m_singleChannel;
+}
+
+bool PageTexture::hasMipmaps() const
+{
+    return false;
+}
+
+bool PageTexture::glFormats(QOpenGLContext *ctx, QImage::Format format,
+                            uint &internalFormat, uint &externalFormat)
+{
+    internalFormat = externalFormat = GL_RGBA;
+    if (format == QImage::Format_ARGB32_Premultiplied && supportsBgra(ctx)) {
+        externalFormat = GL_BGRA;
+        if (ctx->isOpenGLES())
+            internalFormat = GL_BGRA;
+        return true;
+    }
+    return format == QImage::Format_RGBA8888_Premultiplied;
+}
+
+void PageTexture::bind()
+{
+    QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+    if (m_textureId) {
+        f->glBindTexture(GL_TEXTURE_2D, m_textureId);
+        updateBindOptions(false);
+        return;
+    }
+    f->glGenTextures(1, &m_textureId);
+    f->glBindTexture(GL_TEXTURE_2D, m_textureId);
+    updateBindOptions(true);
+    upload();
+}
+
+void PageTexture::upload()
+{
+    TraceScope trace("scenegraph", "PageTexture::upload");
+    QOpenGLContext *ctx = QOpenGLContext::currentContext();
+    QOpenGLFunctions *f = ctx->functions();
+    QImage image = m_image;
+    if (m_singleChannel) {
+        const GLenum format = supportsRed(ctx) ? GL_RED : GL_LUMINANCE;
+        const GLenum internalFormat = (format == GL_RED) ? GL_R8 : GL_LUMINANCE;
+        if (image.bytesPerLine() % 4)
+            image = image.copy(); // never the case for QImage-allocated buffers
+        f->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        f->glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width(), image.height(), 0,
+                        format, GL_UNSIGNED_BYTE, image.constBits());
+        m_image = QImage();
+        return;
+    }
+    uint internalFormat;
+    uint externalFormat;
+    if (!glFormats(ctx, image.format(), internalFormat, externalFormat)) {
+        // Not prepared by the worker, e.g. rendered before the format got refined
+        image = image.convertToFormat(QImage::Format_RGBA8888_Premultiplied);
+    }
+    // 32 bpp scanlines are always 4-byte aligned; rows may still be padded
+    // when the image is a view on a larger buffer
+    if (image.bytesPerLine() != image.width() * 4)
+        image = image.copy();
+    f->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    f->glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width(), image.height(), 0,
+                    externalFormat, GL_UNSIGNED_BYTE, image.constBits());
+    m_image = QImage();
+}
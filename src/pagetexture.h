@@ -0,0 +1,84 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef PAGETEXTURE_H
+#define PAGETEXTURE_H
+
+#include <QQuickTextureFactory>
+#include <QSGTexture>
+#include <QImage>
+
+class QOpenGLContext;
+
+// Texture factory for rendered pages. Unlike the factory of
+// QQuickTextureFactory::textureFactoryForImage, the image is expected to be
+// already in the format the GL upload consumes (see prepare()), and it is
+// handed to glTexImage2D as it is: no conversion nor swizzle happens on the
+// render thread.
+class PageTextureFactory : public QQuickTextureFactory
+{
+public:
+    PageTextureFactory(const QImage &image);
+
+    QSGTexture *createTexture(QQuickWindow *window) const override;
+    QSize textureSize() const override;
+    int textureByteCount() const override;
+    QImage image() const override;
+
+    // The pixel format uploads take as is: ARGB32_Premultiplied where BGRA
+    // uploads are supported (always on desktop GL), RGBA8888_Premultiplied
+    // otherwise. Refined when the first texture gets created.
+    static QImage::Format uploadFormat();
+    // Converts image to uploadFormat(), Grayscale8 images are left as they
+    // are. Meant for the render workers.
+    static QImage prepare(const QImage &image);
+
+private:
+    QImage m_image;
+};
+
+class PageTexture : public QSGTexture
+{
+    Q_OBJECT
+public:
+    PageTexture(const QImage &image);
+    ~PageTexture() override;
+
+    int textureId() const override;
+    QSize textureSize() const override;
+    bool hasAlphaChannel() const override;
+    bool hasMipmaps() const override;
+    void bind() override;
+
+    // Grayscale8 pages: the luminance lives in the red channel only, and the
+    // material has to expand it (see CoolTextureMaterialShader)
+    bool isSingleChannel() const;
+
+    // GL formats for uploading 32 bpp images of the given format as they are.
+    // Returns false if the format has to be converted to RGBA8888_Premultiplied
+    // first, which the formats are then for.
+    static bool glFormats(QOpenGLContext *ctx, QImage::Format format,
+                          uint &internalFormat, uint &externalFormat);
+
+private:
+    void upload();
+
+    QImage m_image; // released once uploaded
+    QSize m_size;
+    bool m_hasAlpha;
+    bool m_singleChannel;
+    uint m_textureId = 0;
+};
+
+#endif // PAGETEXTURE_H
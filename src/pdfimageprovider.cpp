@@ -14,17 +14,33 @@ In addition to the above,
 
 #include "pdfimageprovider.h"
 #include <QPdfDocument>
+#include <QPdfSelection>
 #include <QFileInfo>
+#include <QMutexLocker>
 #include <QtCore/qmath.h>
 #include <QVector4D>
+#include <QElapsedTimer>
+#include <QQmlEngine>
+#include "rendermetrics.h"
+#include "tracelog.h"
+#include "pagetexture.h"
+#include "pagegrayscale.h"
+#include "imagememorygovernor.h"
+#include "pagegeometryindex.h"
+
+namespace {
+// Of resolved search hits kept by PdfManager
+const int kMaxSearchHitRects = 4096;
+}
 
 class AsyncImageResponse : public QQuickImageResponse, public QRunnable
 {
 public:
-    AsyncImageResponse(const QString &id, const QSize &requestedSize, PdfManager &pdfManager)
-     : m_id(id), m_requestedSize(requestedSize), m_manager(pdfManager)
+    AsyncImageResponse(const QString &id, const QSize &requestedSize, PdfManager &pdfManager, PdfImageProvider &provider)
+     : m_id(id), m_requestedSize(requestedSize), m_manager(pdfManager), m_provider(provider)
     {
         setAutoDelete(false);
+        m_issued.start();
         // m_id should be document/page
         QStringList parts = m_id.split('/');
         if (parts.size() < 2)
@@ -38,6 +54,19 @@ public:
             // qDebug() << "Image Request w/o margins";
             return;
         }
+        // Tile requests carry "tile/x,y,w,h", the tile rect in the (cropped) raster
+        const int tileIdx = parts.indexOf(QStringLiteral("tile"));
+        if (tileIdx >= 0 && tileIdx + 1 < parts.size()) {
+            QStringList rect = parts.at(tileIdx + 1).split(",");
+            if (rect.size() == 4)
+                m_tile = QRect(rect[0].toInt(), rect[1].toInt(), rect[2].toInt(), rect[3].toInt());
+        }
+        // Low resolution placeholder, requested by progressive FlickerlessImages
+        m_preview = parts.contains(QStringLiteral("preview"));
+        if (parts.contains(QStringLiteral("grayscale")))
+            m_colorMode = PdfManager::Grayscale;
+        else if (parts.contains(QStringLiteral("autograyscale")))
+            m_colorMode = PdfManager::AutoGrayscale;
         QString mrgs = parts.at(2);
         mrgs = mrgs.mid(1, mrgs.size() - 2);
         QStringList margins = mrgs.split(",");
@@ -50,42 +79,139 @@ public:
         // qDebug() << "Image Request w margins:" << id << mrgs << margins << m_margins ;
     }
 
-    static QSize croppableSize(const QSize &requestedSize, const QVector4D &margins)
+    PageRenderKey key() const
+    {
+        PageRenderKey k;
+        k.documentId = m_documentId;
+        k.page = m_page;
+        k.size = m_requestedSize;
+        k.margins = m_margins;
+        k.tile = m_tile;
+        k.colorMode = m_colorMode;
+        return k;
+    }
+
+    // The page is scaled uniformly so that the horizontally cropped area
+    // spans requestedSize.width(). The scale factor is therefore derived from the
+    // left/right margins alone, for both axes, while top/bottom margins only
+    // define how much of the scaled height is kept.
+    static QSize pageRasterSize(const QSize &requestedSize, const QVector4D &margins)
+    {
+        const qreal s = 1.0 / (1.0 - margins.x() - margins.z());
+        return QSize(qRound(requestedSize.width() * s),
+                     qRound(requestedSize.height() * s));
+    }
+
+    // The visible part of the page, in page raster coordinates
+    static QRect cropRect(const QSize &requestedSize, const QSize &pageRaster, const QVector4D &margins)
+    {
+        const int x = qRound(pageRaster.width() * margins.x());
+        const int y = qRound(pageRaster.height() * margins.y());
+        const int bottom = qRound(pageRaster.height() * (1.0 - margins.w()));
+        return QRect(x, y, requestedSize.width(), qMax(1, bottom - y));
+    }
+
+    // Called from the thread that issued the request, once the requesting
+    // items are gone or have been re-sourced. finished() must still be emitted
+    // exactly once, as that is what gets the response deleted.
+    void cancel() override
     {
-        int width = (float(requestedSize.width())
-                     / (1.0 - margins.x() - margins.z()));
-//        int height = (float(requestedSize.height())
-//                      / (1.0 - margins.y() - margins.w()));
-        int height = (float(requestedSize.height())
-                      / (1.0 - margins.x() - margins.z()));
-        return QSize(width, height);
+        m_cancelled.storeRelease(1);
+        RenderMetrics::instance().count(RenderMetrics::Cancelled);
+        if (m_provider.m_scheduler.tryTake(this)) // still queued, never going to run
+            emit finished();
+    }
+
+    bool isCancelled() const
+    {
+        return m_cancelled.loadAcquire();
+    }
+
+    // Prefetches have no requester: nobody deletes them on finished()
+    void complete()
+    {
+        if (m_prefetch)
+            deleteLater();
+        else
+            emit finished();
     }
 
     void run() override
     {
-        QSize sz = croppableSize(m_requestedSize, m_margins);
-        m_image = m_manager.render(m_documentId, m_page, sz);
-//        QString output = "/tmp/PDF" + QString::number(m_documentId) + "_" +
-//                QString::number(m_page) + ".png" ;
-//        m_image.save(output);
-        if (!m_margins.isNull()) { // crop
-//            m_image = m_image.copy((sz.width() * m_margins.x()),
-//                                   (sz.height() * m_margins.y()),
-//                                   m_requestedSize.width(),
-//                                   m_requestedSize.height());
-            qreal heightPct = (1.0 - m_margins.y() - m_margins.w());
-            m_image = m_image.copy((sz.width() * m_margins.x()),
-                                   (sz.height() * m_margins.y()),
-                                   m_requestedSize.width(),
-                                   m_image.height() * heightPct);
+        TraceScope trace("render", (m_prefetch) ? "AsyncImageResponse::run (prefetch)" : "AsyncImageResponse::run", m_id);
+        if (m_prefetch)
+            m_provider.prefetchStarted(this);
+        RenderMetrics &metrics = RenderMetrics::instance();
+        metrics.record(RenderMetrics::QueueWait, m_issued.nsecsElapsed());
+        if (isCancelled()) {
+            complete();
+            return;
+        }
+
+        const PageRenderKey k = key();
+        // Possibly rendered by a prefetch, after this was queued
+        if (m_provider.m_cache.find(k, m_image)) {
+            metrics.count(RenderMetrics::MemoryCacheHits);
+            complete();
+            return;
+        }
+        if (m_provider.m_diskCache.find(k, m_image)) {
+            metrics.count(RenderMetrics::DiskCacheHits);
+            m_image = PageTextureFactory::prepare(m_image); // in case it was stored differently
+            m_provider.m_cache.insert(k, m_image);
+            complete();
+            return;
+        }
+
+        const QSize sz = pageRasterSize(m_requestedSize, m_margins);
+        const QRect crop = cropRect(m_requestedSize, sz, m_margins);
+        QElapsedTimer renderTimer;
+        renderTimer.start();
+        if (m_tile.isValid()) {
+            // m_tile is relative to the cropped raster, shift it into the page raster
+            m_image = m_manager.render(m_documentId, m_page, sz,
+                                       m_tile.translated(crop.topLeft()).intersected(crop),
+                                       m_colorMode, &m_cancelled);
+        } else if (!m_margins.isNull()) {
+            // Rasterize only the visible rectangle, directly at its final size
+            m_image = m_manager.render(m_documentId, m_page, sz, crop, m_colorMode, &m_cancelled);
+        } else {
+            m_image = m_manager.render(m_documentId, m_page, sz, QRect(), m_colorMode, &m_cancelled);
+        }
+        if (m_image.isNull() && isCancelled()) {
+            complete();
+            return;
         }
 //        qDebug() << "Image Rendered:" << m_documentId << m_margins << m_image.size();
-        emit finished();
+        // Cropping happens within pdfium, through the clip rect: clipped
+        // renders are accounted separately from whole page ones
+        metrics.record((m_tile.isValid() || !m_margins.isNull()) ? RenderMetrics::Crop : RenderMetrics::Render,
+                       renderTimer.nsecsElapsed());
+        metrics.count(RenderMetrics::Renders);
+        // Convert here rather than on the render thread, before uploading
+        m_image = PageTextureFactory::prepare(m_image);
+        m_provider.m_cache.insert(k, m_image);
+        if (isCancelled()) {
+            // Nobody is waiting for it anymore: keep it only in memory, in case
+            // the page comes back, and skip the disk write and the texture
+            m_image = QImage();
+            complete();
+            return;
+        }
+        m_provider.m_diskCache.insert(k, m_image);
+        if (m_prefetch)
+            m_image = QImage(); // in the caches already
+        complete();
     }
 
     QQuickTextureFactory *textureFactory() const override
     {
-        return QQuickTextureFactory::textureFactoryForImage(m_image);
+        TraceScope trace("render", "AsyncImageResponse::textureFactory", m_id);
+        QElapsedTimer t;
+        t.start();
+        QQuickTextureFactory *factory = (m_image.isNull()) ? nullptr : new PageTextureFactory(m_image);
+        RenderMetrics::instance().record(RenderMetrics::TextureFactory, t.nsecsElapsed());
+        return factory;
     }
 
     QString m_id;
@@ -94,7 +220,14 @@ public:
     QSize m_requestedSize;
     QImage m_image;
     PdfManager &m_manager;
+    PdfImageProvider &m_provider;
     QVector4D m_margins;
+    QRect m_tile;
+    bool m_preview = false;
+    bool m_prefetch = false;
+    PdfManager::ColorMode m_colorMode = PdfManager::Color;
+    QAtomicInt m_cancelled;
+    QElapsedTimer m_issued;
 };
 
 QQuickImageResponse *PdfImageProvider::requestImageResponse(const QString &id, const QSize &requestedSize)
@@ -102,11 +235,65 @@ QQuickImageResponse *PdfImageProvider::requestImageResponse(const QString &id, c
     if (!m_manager)
         return nullptr;
 
-    AsyncImageResponse *response = new AsyncImageResponse(id, requestedSize, *m_manager);
-    m_pool.start(response);
+    TraceScope trace("render", "PdfImageProvider::requestImageResponse", id);
+    AsyncImageResponse *response = new AsyncImageResponse(id, requestedSize, *m_manager, *this);
+    RenderMetrics::instance().count(RenderMetrics::Requests);
+    if (m_cache.find(response->key(), response->m_image)
+            || (response->m_preview
+                && m_cache.findAnySize(response->m_documentId,
+                                       response->m_page,
+                                       response->m_margins,
+                                       response->m_colorMode,
+                                       response->m_image))) {
+        // Cache hit: no need to go through the pool. Queued, as the caller
+        // connects to finished() only after this returns.
+        // Previews accept a render of any size, as it's only a placeholder.
+        RenderMetrics::instance().count(RenderMetrics::MemoryCacheHits);
+        QMetaObject::invokeMethod(response, "finished", Qt::QueuedConnection);
+        return response;
+    }
+    m_scheduler.start(response,
+                      response->m_documentId,
+                      response->m_page,
+                      (response->m_preview) ? RenderScheduler::Preview : RenderScheduler::Adjacent);
     return response;
 }
 
+void PdfImageProvider::prefetch(const QVector<QPair<QString, QSize>> &requests)
+{
+    if (!m_manager)
+        return;
+    QMutexLocker locker(&m_prefetchMutex);
+    // Drop what the previous call queued and is not running yet
+    for (AsyncImageResponse *r: qAsConst(m_prefetches)) {
+        if (m_scheduler.tryTake(r))
+            delete r;
+    }
+    m_prefetches.clear();
+
+    QImage cached;
+    for (const auto &request: requests) {
+        AsyncImageResponse *response = new AsyncImageResponse(request.first, request.second, *m_manager, *this);
+        if (response->m_documentId < 0 || m_cache.find(response->key(), cached)) {
+            delete response;
+            continue;
+        }
+        response->m_prefetch = true;
+        RenderMetrics::instance().count(RenderMetrics::Prefetches);
+        m_prefetches.append(response);
+        m_scheduler.start(response,
+                          response->m_documentId,
+                          response->m_page,
+                          RenderScheduler::Speculative);
+    }
+}
+
+void PdfImageProvider::prefetchStarted(AsyncImageResponse *response)
+{
+    QMutexLocker locker(&m_prefetchMutex);
+    m_prefetches.removeOne(response);
+}
+
 PdfImageProvider &PdfImageProvider::instance()
 {
     static PdfImageProvider pdfProvider; // Guaranteed to be destroyed.
@@ -119,8 +306,11 @@ void PdfImageProvider::setManager(PdfManager &manager)
     m_manager = &manager;
 }
 
+
 PdfImageProvider::PdfImageProvider()
     : QQuickAsyncImageProvider()
+    , m_scheduler(DocumentReplicaPool::DefaultMaxReplicas)
+    , m_cache(256 * 1024 * 1024)
 {
 
 }
@@ -205,64 +395,246 @@ static PdfManager::DocumentLayout calculateDocumentLayout(QPdfDocument &m_docume
 
 
 PdfManager::PdfManager(QObject *parent) : QObject(parent)
+    , m_snapshot(std::shared_ptr<const DocumentSnapshot>(std::make_shared<DocumentSnapshot>()))
 {
     PdfImageProvider::instance().setManager(*this);
+    m_loadPool.setMaxThreadCount(2);
+    m_metricsTimer.setInterval(500);
+    connect(&m_metricsTimer, &QTimer::timeout, this, [this]() {
+        const quint64 version = RenderMetrics::instance().version();
+        if (version == m_metricsVersion)
+            return;
+        m_metricsVersion = version;
+        emit renderMetricsChanged();
+    });
+    m_metricsTimer.start();
+    connect(&PdfImageProvider::instance().m_thumbnails, &ThumbnailStore::thumbnailReady,
+            this, &PdfManager::thumbnailReady);
+    connect(&PdfImageProvider::instance().m_textIndex, &TextIndex::indexReady,
+            this, &PdfManager::textIndexReady);
+    connect(&ImageMemoryGovernor::instance(), &ImageMemoryGovernor::budgetChanged,
+            this, &PdfManager::imageMemoryBudgetChanged);
 }
 
 PdfManager::~PdfManager()
-{}
+{
+    m_loading.clear();
+    m_loadPool.waitForDone(); // the jobs post back to this. Undelivered
+                              // documents go with their pending events
+
+    // Renders, thumbnail and index jobs all hold a reference to this: no new
+    // ones, and the running and queued ones have to be through before the
+    // members go
+    PdfImageProvider &provider = PdfImageProvider::instance();
+    if (provider.m_manager == this)
+        provider.m_manager = nullptr;
+    for (auto it = m_pageSizes.cbegin(); it != m_pageSizes.cend(); ++it) {
+        provider.m_thumbnails.closeDocument(it.key());
+        provider.m_textIndex.closeDocument(it.key());
+    }
+    // Without documents, whatever is still queued finishes right away
+    std::atomic_store(&m_snapshot, std::shared_ptr<const DocumentSnapshot>(std::make_shared<DocumentSnapshot>()));
+    provider.m_thumbnails.waitForDone();
+    provider.m_textIndex.waitForDone();
+    provider.m_scheduler.waitForDone();
+}
+
+// Opens and parses the document, and collects the page sizes and metadata,
+// off the GUI thread. Page sizes come from PageGeometryIndex when the
+// document was opened before. The parsed document then becomes the first
+// replica of the document: it is never parsed twice.
+class DocumentLoadJob : public QRunnable
+{
+public:
+    DocumentLoadJob(PdfManager &manager, int documentId, const QString &filePath, quint64 bytesCount,
+                    const QSharedPointer<DocumentReplicaPool> &replicas)
+        : m_manager(manager), m_documentId(documentId), m_filePath(filePath)
+        , m_bytesCount(bytesCount), m_replicas(replicas) {}
+
+    void run() override
+    {
+        TraceScope trace("document", "DocumentLoadJob::run", m_filePath);
+        const QFileInfo fi(m_filePath);
+        if (!fi.exists() || !fi.isFile()) {
+            fail(QStringLiteral("File not found"));
+            return;
+        }
+        progress(0);
+
+        QPdfDocument *document = new QPdfDocument;
+        // Maps the file for further replicas too. pdfium reports no progress
+        // while parsing the xref table and page tree.
+        if (!m_replicas->load(document)) {
+            const QString error = QStringLiteral("Load failed: %1").arg(int(document->error()));
+            delete document;
+            fail(error);
+            return;
+        }
+
+        const int pageCount = document->pageCount();
+        QVariantMap metaData;
+        const QMetaEnum metaEnum = QMetaEnum::fromType<QPdfDocument::MetaDataField>();
+        for (int i = 0; i < metaEnum.keyCount(); ++i) {
+            const auto field = QPdfDocument::MetaDataField(metaEnum.value(i));
+            metaData[metaEnum.key(i)] = document->metaData(field);
+        }
+
+        const QString fileName = QFileInfo(m_filePath).fileName();
+        QVector<QSizeF> pageSizes = PageGeometryIndex::load(fileName, m_bytesCount, pageCount);
+        if (pageSizes.isEmpty()) { // not opened before
+            pageSizes.reserve(pageCount);
+            int reported = 0;
+            for (int i = 0; i < pageCount; ++i) {
+                pageSizes.append(document->pageSize(i));
+                const int percent = (i + 1) * 100 / pageCount;
+                if (percent > reported) {
+                    reported = percent;
+                    progress(percent / 100.0);
+                }
+            }
+            PageGeometryIndex::store(fileName, m_bytesCount, pageSizes);
+        } else {
+            progress(1);
+        }
+        m_replicas->adopt(document);
+        deliver(pageSizes, metaData, QString());
+    }
+
+private:
+    void progress(qreal p)
+    {
+        PdfManager *manager = &m_manager;
+        const int documentId = m_documentId;
+        QMetaObject::invokeMethod(manager, [manager, documentId, p]() {
+            if (manager->m_loading.contains(documentId))
+                emit manager->loadProgress(documentId, p);
+        }, Qt::QueuedConnection);
+    }
+
+    void fail(const QString &error)
+    {
+        m_replicas->adopt(nullptr); // releases whoever waits for a replica
+        deliver(QVector<QSizeF>(), QVariantMap(), error);
+    }
+
+    void deliver(const QVector<QSizeF> &pageSizes, const QVariantMap &metaData, const QString &error)
+    {
+        PdfManager *manager = &m_manager;
+        const int documentId = m_documentId;
+        QMetaObject::invokeMethod(manager, [manager, documentId, pageSizes, metaData, error]() {
+            manager->onDocumentLoaded(documentId, pageSizes, metaData, error);
+        }, Qt::QueuedConnection);
+    }
+
+    PdfManager &m_manager;
+    const int m_documentId;
+    const QString m_filePath;
+    const quint64 m_bytesCount;
+    const QSharedPointer<DocumentReplicaPool> m_replicas;
+};
 
 // returns the document id
 int PdfManager::openDocument(const QUrl &doc)
 {
     // ToDo use QNam to fetch from both local AND remote.
     const QString filePath = doc.toString(QUrl::NormalizePathSegments);
-    const bool fileExists = QFileInfo::exists(filePath) && QFileInfo(filePath).isFile();
-    if (!fileExists)
-        return -1;
 
     m_maxId++;
     int documentId = m_maxId;
 
-    QPdfDocument *dc = new QPdfDocument(this);
-    m_documents[documentId] = dc;
-    m_documentsFileName[documentId] = QFileInfo(filePath).fileName();
-    connect(dc, &QPdfDocument::statusChanged,
-            [this, documentId](const QPdfDocument::Status &status) {
-                if (status == QPdfDocument::Ready)
-                    this->onLoadFinished(documentId);
-                else {
-                    qWarning() << "QPdfDocument status changed for " << documentId << " : " << status;
-                }
-            });
-    dc->load(filePath);
+    const QFileInfo fi(filePath);
+    m_documentsFileName[documentId] = fi.fileName();
+    m_bytesCounts[documentId] = quint64(qMax<qint64>(0, fi.size()));
+    m_urls[documentId] = doc;
+    m_loading.insert(documentId);
+    // The disk cache only needs the key: a reopened document shows its cached
+    // pages while still being parsed
+    if (fi.isFile())
+        PdfImageProvider::instance().m_diskCache.openDocument(documentId, documentKey(documentId));
+
+    QSharedPointer<DocumentState> state(new DocumentState);
+    state->filePath = filePath;
+    // The document parsed by the load job is the first replica. Others, if
+    // allowed, are created on demand and share the mapping of the file.
+    state->replicas = QSharedPointer<DocumentReplicaPool>::create(filePath, m_maxDocumentReplicas);
+    // Opened before: the pages are known already. Renders wait for the parse.
+    const QVector<QSizeF> pageSizes = PageGeometryIndex::load(fi.fileName(), m_bytesCounts.value(documentId), -1);
+    if (!pageSizes.isEmpty()) {
+        m_pageSizes[documentId] = pageSizes;
+        state->ready = true;
+        state->pageCount = pageSizes.size();
+    }
+    publishDocumentState(documentId, state);
+    if (state->ready) {
+        // The caller gets the id first. Posted before the load job can post
+        // its outcome
+        QMetaObject::invokeMethod(this, [this, documentId]() {
+            if (isReady(documentId))
+                emit ready(documentId);
+        }, Qt::QueuedConnection);
+    }
+    m_loadPool.start(new DocumentLoadJob(*this, documentId, filePath, m_bytesCounts.value(documentId),
+                                         state->replicas));
     return documentId;
 }
 
+void PdfManager::onDocumentLoaded(int documentId, const QVector<QSizeF> &pageSizes,
+                                  const QVariantMap &metaData, const QString &error)
+{
+    if (!m_loading.remove(documentId)) // closed meanwhile, the replicas go with the job
+        return;
+    if (!error.isEmpty()) {
+        qWarning() << "PdfManager: cannot open" << m_urls.value(documentId) << error;
+        releaseDocument(documentId);
+        emit loadFailed(documentId, error);
+        return;
+    }
+    m_pageSizes[documentId] = pageSizes;
+    m_metaData[documentId] = metaData;
+    onLoadFinished(documentId);
+}
+
 void PdfManager::closeDocument(int documentId)
 {
-    if (!m_documents.contains(documentId) || m_documents[documentId].isNull())
+    // A document still loading finds out when done
+    if (!m_loading.remove(documentId) && !m_pageSizes.contains(documentId))
         return;
-    m_documents[documentId]->deleteLater();
-    m_documents.remove(documentId);
+    releaseDocument(documentId);
+}
+
+void PdfManager::releaseDocument(int documentId)
+{
+    m_pageSizes.remove(documentId);
+    m_bytesCounts.remove(documentId);
+    m_metaData.remove(documentId);
+    PdfImageProvider::instance().m_cache.removeDocument(documentId);
+    PdfImageProvider::instance().m_diskCache.closeDocument(documentId);
+    PdfImageProvider::instance().m_thumbnails.closeDocument(documentId);
+    PdfImageProvider::instance().m_textIndex.closeDocument(documentId);
+    PdfImageProvider::instance().m_scheduler.removeDocument(documentId);
+    removeSearchHitRects(documentId);
+    // replicas go once the running renders release them
+    publishDocumentState(documentId, QSharedPointer<const DocumentState>());
+}
+
+// Same key used by the per-document Settings in main.qml
+QString PdfManager::documentKey(int documentId) const
+{
+    return m_documentsFileName.value(documentId) + QString::number(m_bytesCounts.value(documentId));
 }
 
 int PdfManager::pageCount(int documentId)
 {
-    if (!m_documents.contains(documentId))
-        return 0;
     if (!isReady(documentId))
         return 0;
-    return m_documents.value(documentId)->pageCount();
+    return m_pageSizes.value(documentId).size();
 }
 
 quint64 PdfManager::bytesCount(int documentId)
 {
-    if (!m_documents.contains(documentId))
-        return 0;
     if (!isReady(documentId))
         return 0;
-    return m_documents.value(documentId)->bytesCount();
+    return m_bytesCounts.value(documentId);
 }
 
 QString PdfManager::fileName(int documentId)
@@ -278,79 +650,257 @@ QString PdfManager::fileName(int documentId)
 
 QSizeF PdfManager::pageSize(int documentId, int page)
 {
-    if (!m_documents.contains(documentId))
-        return QSizeF();;
     if (!isReady(documentId))
-        return QSizeF();;
-    if (page < 0 || page >= pageCount(documentId))
         return QSizeF();
-    return m_documents.value(documentId)->pageSize(page);
+    return m_pageSizes.value(documentId).value(page);
 }
 
 QVariantMap PdfManager::metadata(int documentId)
 {
-    if (!m_documents.contains(documentId))
-        return QVariantMap();
     if (!isReady(documentId))
         return QVariantMap();
-    QList<QPdfDocument::MetaDataField> fields { {         QPdfDocument::Title,
-                    QPdfDocument::Subject,
-                    QPdfDocument::Author,
-                    QPdfDocument::Keywords,
-                    QPdfDocument::Producer,
-                    QPdfDocument::Creator,
-                    QPdfDocument::CreationDate,
-                    QPdfDocument::ModificationDate } };
-    QMetaEnum metaEnum = QMetaEnum::fromType<QPdfDocument::MetaDataField>();
-    QVariantMap meta;
-    for (const auto f: fields)
-        meta[metaEnum.valueToKey(f)] = m_documents.value(documentId)->metaData(f);
-
+    QVariantMap meta = m_metaData.value(documentId);
     meta["Url"] = m_urls[documentId];
     return meta;
 }
 
-QVariantList PdfManager::pages(int documentId)
+PdfPageModel *PdfManager::pages(int documentId)
 {
-    QVariantList p;
-    if (!m_documents.contains(documentId))
-        return p;
-    if (!isReady(documentId))
-        return p;
+    const QVector<QSizeF> pageSizes = (isReady(documentId)) ? m_pageSizes.value(documentId)
+                                                            : QVector<QSizeF>();
+    PdfPageModel *model = new PdfPageModel(documentId, pageSizes);
+    QQmlEngine::setObjectOwnership(model, QQmlEngine::JavaScriptOwnership);
+    return model;
+}
+
+void PdfManager::setViewport(int documentId, int firstPage, int lastPage)
+{
+    PdfImageProvider::instance().m_scheduler.setViewport(documentId, firstPage, lastPage);
+}
+
+qint64 PdfManager::renderCacheBudget() const
+{
+    return PdfImageProvider::instance().m_cache.budget();
+}
+
+void PdfManager::setRenderCacheBudget(qint64 bytes)
+{
+    if (bytes == renderCacheBudget())
+        return;
+    PdfImageProvider::instance().m_cache.setBudget(bytes);
+    emit renderCacheBudgetChanged();
+}
+
+qint64 PdfManager::imageMemoryBudget() const
+{
+    return ImageMemoryGovernor::instance().budget();
+}
+
+void PdfManager::setImageMemoryBudget(qint64 bytes)
+{
+    ImageMemoryGovernor::instance().setBudget(bytes);
+}
+
+int PdfManager::maxDocumentReplicas() const
+{
+    return m_maxDocumentReplicas;
+}
 
-    for (int i = 0; i < pageCount(documentId); i++) {
+void PdfManager::setMaxDocumentReplicas(int replicas)
+{
+    replicas = qMax(1, replicas);
+    if (replicas == m_maxDocumentReplicas)
+        return;
+    m_maxDocumentReplicas = replicas;
+    // One worker per replica, see RenderScheduler
+    PdfImageProvider::instance().m_scheduler.setThreadCount(replicas);
+    emit maxDocumentReplicasChanged();
+}
+
+bool PdfManager::backgroundJobsEnabled() const
+{
+    return m_backgroundJobs;
+}
+
+void PdfManager::setBackgroundJobsEnabled(bool enabled)
+{
+    m_backgroundJobs = enabled;
+}
+
+QVariantMap PdfManager::renderMetrics() const
+{
+    return RenderMetrics::instance().toVariantMap();
+}
+
+void PdfManager::resetRenderMetrics()
+{
+    RenderMetrics::instance().reset();
+    m_metricsVersion = RenderMetrics::instance().version();
+    emit renderMetricsChanged();
+}
+
+bool PdfManager::hasThumbnail(int documentId, int page)
+{
+    return PdfImageProvider::instance().m_thumbnails.contains(documentId, page);
+}
+
+bool PdfManager::isTextIndexed(int documentId)
+{
+    return PdfImageProvider::instance().m_textIndex.isIndexed(documentId);
+}
+
+QVariantList PdfManager::search(int documentId, const QString &query, int maxHits)
+{
+    QVariantList res;
+    const QVector<TextIndex::Hit> hits
+            = PdfImageProvider::instance().m_textIndex.search(documentId, query, maxHits);
+    res.reserve(hits.size());
+    for (const TextIndex::Hit &hit: hits) {
         QVariantMap entry;
-        entry["image"] =  QStringLiteral("image://pdfpages/")
-                        + QString::number(documentId)
-                        + QStringLiteral("/")
-                        + QString::number(i);
-        entry["page_number"] = QString::number(i);
-        entry["doc_id"] = QString::number(documentId);
-        QSizeF ps = pageSize(documentId, i);
-        entry["page_width"] = ps.width();
-        entry["page_height"] = ps.height();
-        entry["page_ar"] = ps.width() / ps.height();
-        p.append(entry);
+        entry[QStringLiteral("page")] = hit.page;
+        entry[QStringLiteral("start")] = hit.start;
+        entry[QStringLiteral("length")] = hit.length;
+        res.append(entry);
     }
-    return p;
+    return res;
+}
+
+// Resolves the rectangles of a search hit with a replica, so that the GUI
+// thread never waits on the pdfium lock behind a page render
+class SearchHitRectsTask : public QRunnable
+{
+public:
+    SearchHitRectsTask(PdfManager &manager, const PdfManager::SearchHitKey &key)
+        : m_manager(manager), m_key(key) {}
+
+    void run() override
+    {
+        TraceScope trace("render", "SearchHitRectsTask::run", QString::number(m_key.page));
+        QVariantList rects;
+        bool resolved = false;
+        const QSharedPointer<const PdfManager::DocumentState> state
+                = m_manager.documentState(m_key.documentId);
+        if (state && state->ready) {
+            DocumentReplicaPool::Lease lease(state->replicas);
+            if (lease.document()) {
+                const QSizeF ps = lease.document()->pageSize(m_key.page);
+                const QPdfSelection selection
+                        = lease.document()->getSelectionAtIndex(m_key.page, m_key.start, m_key.length);
+                if (!ps.isEmpty()) {
+                    for (const QPolygonF &bounds: selection.bounds()) {
+                        const QRectF r = bounds.boundingRect();
+                        rects.append(QRectF(r.x() / ps.width(), r.y() / ps.height(),
+                                            r.width() / ps.width(), r.height() / ps.height()));
+                    }
+                }
+                resolved = true;
+            }
+        }
+        PdfManager *manager = &m_manager;
+        const PdfManager::SearchHitKey key = m_key;
+        QMetaObject::invokeMethod(manager, [manager, key, rects, resolved]() {
+            if (resolved)
+                manager->onSearchHitRectsResolved(key, rects);
+            else
+                manager->m_searchHitRectsPending.remove(key);
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    PdfManager &m_manager;
+    const PdfManager::SearchHitKey m_key;
+};
+
+// Only for the hits being shown, the index keeps no geometry
+QVariantList PdfManager::searchHitRects(int documentId, int page, int start, int length)
+{
+    if (page < 0 || page >= pageCount(documentId))
+        return QVariantList();
+    const SearchHitKey key { documentId, page, start, length };
+    const auto it = m_searchHitRects.constFind(key);
+    if (it != m_searchHitRects.constEnd())
+        return it.value();
+    if (!m_searchHitRectsPending.contains(key)) {
+        m_searchHitRectsPending.insert(key);
+        // Asked for by the delegates on screen
+        PdfImageProvider::instance().m_scheduler.start(new SearchHitRectsTask(*this, key),
+                                                       documentId, page, RenderScheduler::Visible);
+    }
+    return QVariantList();
+}
+
+void PdfManager::removeSearchHitRects(int documentId)
+{
+    for (auto it = m_searchHitRects.begin(); it != m_searchHitRects.end(); ) {
+        if (it.key().documentId == documentId)
+            it = m_searchHitRects.erase(it);
+        else
+            ++it;
+    }
+    for (auto it = m_searchHitRectsPending.begin(); it != m_searchHitRectsPending.end(); ) {
+        if (it->documentId == documentId)
+            it = m_searchHitRectsPending.erase(it);
+        else
+            ++it;
+    }
+}
+
+void PdfManager::onSearchHitRectsResolved(const SearchHitKey &key, const QVariantList &rects)
+{
+    if (!m_searchHitRectsPending.remove(key)) // document closed meanwhile
+        return;
+    // Every query typed adds its hits: start over rather than track usage
+    if (m_searchHitRects.size() >= kMaxSearchHitRects)
+        m_searchHitRects.clear();
+    m_searchHitRects.insert(key, rects);
+    emit searchHitRectsReady(key.documentId, key.page);
 }
 
 bool PdfManager::isReady(int documentId)
 {
-    return m_ready.value(documentId, false);
+    const QSharedPointer<const DocumentState> state = documentState(documentId);
+    return state && state->ready;
 }
 
-QImage PdfManager::render(int documentId, int page, QSize imageSize /*,QPdfDocumentRenderOptions options*/ )
+// std::atomic_load/store on shared_ptr are not lock free: libstdc++ guards
+// them with a mutex from a global pool, held only for the pointer copy and
+// the reference count update. Readers therefore never wait for a publication
+// to be built, only for that copy.
+std::shared_ptr<const PdfManager::DocumentSnapshot> PdfManager::snapshot() const
 {
-    if (!m_documents.contains(documentId))
-        return QImage();;
-    if (!isReady(documentId))
-        return QImage();;
-    if (page < 0 || page >= pageCount(documentId))
+    return std::atomic_load(&m_snapshot);
+}
+
+QSharedPointer<const PdfManager::DocumentState> PdfManager::documentState(int documentId) const
+{
+    return snapshot()->value(documentId);
+}
+
+void PdfManager::publishDocumentState(int documentId, const QSharedPointer<const DocumentState> &state)
+{
+    // Single writer, so no need for a compare-and-swap loop. Readers keep the
+    // snapshot they loaded alive for as long as they use it.
+    std::shared_ptr<DocumentSnapshot> next = std::make_shared<DocumentSnapshot>(*snapshot());
+    if (state)
+        next->insert(documentId, state);
+    else
+        next->remove(documentId);
+    std::atomic_store(&m_snapshot, std::shared_ptr<const DocumentSnapshot>(std::move(next)));
+}
+
+// Called from the render workers: only touches the published document state
+QImage PdfManager::render(int documentId, int page, QSize imageSize, const QRect &clipRect, ColorMode colorMode,
+                          const QAtomicInt *cancelled /*,QPdfDocumentRenderOptions options*/ )
+{
+    TraceScope trace("render", "PdfManager::render");
+    const QSharedPointer<const DocumentState> state = documentState(documentId);
+    if (!state || !state->ready)
+        return QImage();
+    if (page < 0 || page >= state->pageCount)
         return QImage();
 
     QPdfDocumentRenderOptions opts;
-    opts.setRenderFlags(QPdf::RenderAnnotations
+    QPdf::RenderFlags flags = QPdf::RenderAnnotations
 //                        |QPdf::RenderAnnotations
 //                        |QPdf::RenderOptimizedForLcd
 //                        |QPdf::RenderGrayscale
@@ -358,14 +908,57 @@ QImage PdfManager::render(int documentId, int page, QSize imageSize /*,QPdfDocum
 //                        |QPdf::RenderTextAliased
 //                        |QPdf::RenderImageAliased
 //                        |QPdf::RenderPathAliased
-                        );
-    return m_documents.value(documentId)->render(page, imageSize, opts);
+                        ;
+    if (colorMode == Grayscale)
+        flags |= QPdf::RenderGrayscale;
+    opts.setRenderFlags(flags);
+    QImage res;
+    {
+        // Workers lease a replica for the duration of the render
+        DocumentReplicaPool::Lease lease(state->replicas);
+        if (!lease.document())
+            return QImage();
+        if (cancelled && cancelled->loadAcquire()) // while waiting for the replica
+            return QImage();
+        if (clipRect.isValid()) {
+            opts.setScaledSize(imageSize);
+            opts.setScaledClipRect(clipRect);
+            res = lease.document()->render(page, clipRect.size(), opts);
+        } else {
+            res = lease.document()->render(page, imageSize, opts);
+        }
+    }
+
+    if (colorMode == Grayscale) {
+        res = toGrayscalePage(res, false);
+    } else if (colorMode == AutoGrayscale) {
+        const QImage gray = toGrayscalePage(res, true);
+        if (!gray.isNull())
+            res = gray;
+    }
+    return res;
 }
 
 void PdfManager::onLoadFinished(int documentId)
 {
-    m_ready[documentId] = true;
-    emit ready(documentId);
+    const QSharedPointer<const DocumentState> current = documentState(documentId);
+    if (!current || !m_pageSizes.contains(documentId))
+        return;
+    QSharedPointer<DocumentState> state(new DocumentState(*current));
+    state->ready = true;
+    state->pageCount = m_pageSizes.value(documentId).size();
+    publishDocumentState(documentId, state);
+    // Announced from PageGeometryIndex already, unless it turned out stale
+    if (!current->ready || current->pageCount != state->pageCount)
+        emit ready(documentId);
+
+    if (!m_backgroundJobs)
+        return;
+    const QString key = documentKey(documentId);
+    PdfImageProvider::instance().m_thumbnails.openDocument(documentId, key,
+                                                           m_pageSizes.value(documentId), *this);
+    PdfImageProvider::instance().m_textIndex.openDocument(documentId, key,
+                                                          state->pageCount, *this);
 }
 
 
@@ -28,6 +28,20 @@ In addition to the above,
 #include <QPointer>
 #include <QThreadPool>
 #include <QSharedPointer>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QVector>
+#include <QPair>
+#include <QTimer>
+#include <QSet>
+#include "pagerendercache.h"
+#include "diskpagecache.h"
+#include "renderscheduler.h"
+#include "documentreplicapool.h"
+#include "thumbnailstore.h"
+#include "textindex.h"
+#include "pdfpagemodel.h"
+#include <memory>
 
 
 
@@ -35,10 +49,26 @@ In addition to the above,
 class PdfManager : public QObject
 {
     Q_OBJECT
+    // Byte budget of the in-memory cache of rendered pages
+    Q_PROPERTY(qint64 renderCacheBudget READ renderCacheBudget WRITE setRenderCacheBudget NOTIFY renderCacheBudgetChanged)
+    // Byte budget of the images held by all FlickerlessImages, CPU and GPU
+    // side, see ImageMemoryGovernor
+    Q_PROPERTY(qint64 imageMemoryBudget READ imageMemoryBudget WRITE setImageMemoryBudget NOTIFY imageMemoryBudgetChanged)
+    // QPdfDocument handles per document for the render workers, see
+    // DocumentReplicaPool. Applies to the documents opened afterwards, and
+    // sets the number of render workers.
+    Q_PROPERTY(int maxDocumentReplicas READ maxDocumentReplicas WRITE setMaxDocumentReplicas NOTIFY maxDocumentReplicasChanged)
+    // Counters and per-phase latency histograms of the page requests, see
+    // RenderMetrics. Change notifications are throttled.
+    Q_PROPERTY(QVariantMap renderMetrics READ renderMetrics NOTIFY renderMetricsChanged)
 public:
     PdfManager(QObject *parent = nullptr);
     ~PdfManager();
 
+    // Returns the id of the document right away. The file is checked and
+    // parsed on a background thread, reporting loadProgress, and ready or
+    // loadFailed are emitted once done. Documents opened before are ready
+    // as soon as their page geometries are read, while still being parsed.
     Q_INVOKABLE int openDocument(const QUrl &doc);
     Q_INVOKABLE void closeDocument(int documentId);
     Q_INVOKABLE int pageCount(int documentId);
@@ -46,7 +76,23 @@ public:
     Q_INVOKABLE QString fileName(int documentId);
     Q_INVOKABLE QSizeF pageSize(int documentId, int page);
     Q_INVOKABLE QVariantMap metadata(int documentId);
-    Q_INVOKABLE QVariantList pages(int documentId);
+    // A new model of the pages of documentId, owned by the caller (the JS
+    // engine, from QML). Empty until the document is ready.
+    Q_INVOKABLE PdfPageModel *pages(int documentId);
+    // Pages currently on screen. Renders are scheduled by proximity to these
+    Q_INVOKABLE void setViewport(int documentId, int firstPage, int lastPage);
+    Q_INVOKABLE void resetRenderMetrics();
+    // Whether image://pdfthumbs/<documentId>/<page> is available yet
+    Q_INVOKABLE bool hasThumbnail(int documentId, int page);
+    // Whether the text of documentId is indexed yet, see TextIndex
+    Q_INVOKABLE bool isTextIndexed(int documentId);
+    // Occurrences of query in documentId, as { page, start, length } maps
+    // in page order. Empty until the text is indexed.
+    Q_INVOKABLE QVariantList search(int documentId, const QString &query, int maxHits = 1000);
+    // Rectangles covering a search hit, normalized to the page size.
+    // Resolved on the render workers: empty until searchHitRectsReady is
+    // emitted for the page of the hit.
+    Q_INVOKABLE QVariantList searchHitRects(int documentId, int page, int start, int length);
 
     struct DocumentLayout
     {
@@ -61,27 +107,137 @@ public:
     };
     Q_ENUM(PageMode)
 
+    // Grayscale renders are 8 bit luminance images, a quarter of the memory
+    // of colour ones, in the caches as well as on the GPU
+    enum ColorMode
+    {
+        Color = 0,
+        Grayscale,
+        AutoGrayscale // grayscale unless the page turns out to contain colour
+    };
+    Q_ENUM(ColorMode)
+
+    // Per-document state needed by the render workers. Never modified once
+    // published: the GUI thread publishes a new snapshot of all documents
+    // (read-copy-update) and workers read whichever one is current, without
+    // ever waiting on the GUI thread. Not lock free though: see snapshot().
+    struct DocumentState
+    {
+        QString filePath;
+        bool ready = false; // pages known. Renders wait for the parse in replicas
+        int pageCount = 0;
+        QSharedPointer<DocumentReplicaPool> replicas;
+    };
+    typedef QHash<int, QSharedPointer<const DocumentState>> DocumentSnapshot;
+
+    // Safe to call from any thread
+    std::shared_ptr<const DocumentSnapshot> snapshot() const;
+    QSharedPointer<const DocumentState> documentState(int documentId) const;
+
+    qint64 renderCacheBudget() const;
+    void setRenderCacheBudget(qint64 bytes);
+    qint64 imageMemoryBudget() const;
+    void setImageMemoryBudget(qint64 bytes);
+    int maxDocumentReplicas() const;
+    void setMaxDocumentReplicas(int replicas);
+    // Whether thumbnails and the text index of the documents opened
+    // afterwards are generated in the background. On by default
+    bool backgroundJobsEnabled() const;
+    void setBackgroundJobsEnabled(bool enabled);
+
+    QVariantMap renderMetrics() const;
+
     bool isReady(int documentId);
+    // imageSize is the size of the whole page raster. If clipRect is valid,
+    // only that portion of the raster is rendered, into an image of clipRect.size()
+    // Returns a null image if cancelled is set once a replica is leased.
     QImage render(int documentId
                   ,int page
                   ,QSize imageSize
+                  ,const QRect &clipRect = QRect()
+                  ,ColorMode colorMode = Color
+                  ,const QAtomicInt *cancelled = nullptr
                   /*,QPdfDocumentRenderOptions options = QPdfDocumentRenderOptions()*/ );
 
 public slots:
     void onLoadFinished(int documentId);
 signals:
     void ready(int documentId);
+    void loadProgress(int documentId, qreal progress);
+    void loadFailed(int documentId, const QString &error);
+    void renderCacheBudgetChanged();
+    void imageMemoryBudgetChanged();
+    void maxDocumentReplicasChanged();
+    void renderMetricsChanged();
+    void thumbnailReady(int documentId, int page);
+    void textIndexReady(int documentId);
+    void searchHitRectsReady(int documentId, int page);
 
 public:
     QMap<int, DocumentLayout> m_layouts;
     PageMode m_pageMode = SinglePage;
-    QMap<int, QPointer<QPdfDocument>> m_documents;
     QMap<int, QString> m_documentsFileName;
-    QMap<int, bool> m_ready;
     QMap<int, QUrl> m_urls;
     int m_maxId = -1;
+
+    struct SearchHitKey
+    {
+        int documentId;
+        int page;
+        int start;
+        int length;
+        bool operator==(const SearchHitKey &o) const
+        {
+            return documentId == o.documentId && page == o.page
+                    && start == o.start && length == o.length;
+        }
+    };
+
+private:
+    friend class DocumentLoadJob;
+    friend class SearchHitRectsTask;
+    // GUI thread only. A null state removes the document
+    void publishDocumentState(int documentId, const QSharedPointer<const DocumentState> &state);
+    // error is empty on success, the document is then in its replica pool
+    void onDocumentLoaded(int documentId, const QVector<QSizeF> &pageSizes,
+                          const QVariantMap &metaData, const QString &error);
+    void releaseDocument(int documentId);
+    // Of the caches persisted per document: file name and byte count
+    QString documentKey(int documentId) const;
+
+    // GUI thread only
+    void onSearchHitRectsResolved(const SearchHitKey &key, const QVariantList &rects);
+    void removeSearchHitRects(int documentId);
+
+    QSet<int> m_loading;
+    // Collected while loading, page sizes also from PageGeometryIndex on
+    // open. The GUI thread holds no QPdfDocument: these answer its queries
+    QMap<int, QVector<QSizeF>> m_pageSizes;
+    QMap<int, quint64> m_bytesCounts;
+    QMap<int, QVariantMap> m_metaData;
+    QThreadPool m_loadPool;
+    int m_maxDocumentReplicas = DocumentReplicaPool::DefaultMaxReplicas;
+    bool m_backgroundJobs = true;
+    QHash<SearchHitKey, QVariantList> m_searchHitRects;
+    QSet<SearchHitKey> m_searchHitRectsPending;
+
+    std::shared_ptr<const DocumentSnapshot> m_snapshot; // only accessed through std::atomic_load/store
+
+    QTimer m_metricsTimer;
+    quint64 m_metricsVersion = 0;
 };
 
+inline uint qHash(const PdfManager::SearchHitKey &k, uint seed = 0)
+{
+    uint h = qHash(k.documentId, seed);
+    h = h * 31 + qHash(k.page, seed);
+    h = h * 31 + qHash(k.start, seed);
+    h = h * 31 + qHash(k.length, seed);
+    return h;
+}
+
+class AsyncImageResponse;
+
 // ToDo: This crashes on destruction. Figure out why
 class PdfImageProvider : public QQuickAsyncImageProvider
 {
@@ -93,15 +249,29 @@ public:
 
     void setManager(PdfManager &manager);
 
+    // Speculative renders into m_cache, of (id, requestedSize) as passed to
+    // requestImageResponse. Replaces those queued by the previous call.
+    void prefetch(const QVector<QPair<QString, QSize>> &requests);
+
 private:
     PdfImageProvider();
 
+    friend class AsyncImageResponse;
+    void prefetchStarted(AsyncImageResponse *response);
+
+    QMutex m_prefetchMutex;
+    QVector<AsyncImageResponse *> m_prefetches; // queued, not started
+
 public:
     PdfImageProvider(PdfImageProvider const&) = delete;
     void operator=(PdfImageProvider const&)  = delete;
 
     QPointer<PdfManager> m_manager;
-    QThreadPool m_pool;
+    RenderScheduler m_scheduler;
+    PageRenderCache m_cache;
+    DiskPageCache m_diskCache;
+    ThumbnailStore m_thumbnails;
+    TextIndex m_textIndex;
 };
 
 #endif // PDFIMAGEPROVIDER_H
@@ -0,0 +1,91 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "pdfpagemodel.h"
+
+PdfPageModel::PdfPageModel(int documentId, const QVector<QSizeF> &pageSizes, QObject *parent)
+    : QAbstractListModel(parent), m_documentId(documentId), m_pageSizes(pageSizes)
+{
+}
+
+int PdfPageModel::documentId() const
+{
+    return m_documentId;
+}
+
+int PdfPageModel::count() const
+{
+    return m_pageSizes.size();
+}
+
+int PdfPageModel::rowCount(const QModelIndex &parent) const
+{
+    return (parent.isValid()) ? 0 : m_pageSizes.size();
+}
+
+QVariant PdfPageModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_pageSizes.size())
+        return QVariant();
+    const int page = index.row();
+    switch (role) {
+    case ImageRole:
+        return imageSource(page);
+    case PageNumberRole:
+        return QString::number(page);
+    case DocumentIdRole:
+        return QString::number(m_documentId);
+    case PageWidthRole:
+        return m_pageSizes.at(page).width();
+    case PageHeightRole:
+        return m_pageSizes.at(page).height();
+    case PageAspectRatioRole:
+        return aspectRatio(page);
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> PdfPageModel::roleNames() const
+{
+    static const QHash<int, QByteArray> roles {
+        { ImageRole, QByteArrayLiteral("image") },
+        { PageNumberRole, QByteArrayLiteral("page_number") },
+        { DocumentIdRole, QByteArrayLiteral("doc_id") },
+        { PageWidthRole, QByteArrayLiteral("page_width") },
+        { PageHeightRole, QByteArrayLiteral("page_height") },
+        { PageAspectRatioRole, QByteArrayLiteral("page_ar") }
+    };
+    return roles;
+}
+
+QString PdfPageModel::imageSource(int page) const
+{
+    if (page < 0 || page >= m_pageSizes.size())
+        return QString();
+    return QStringLiteral("image://pdfpages/%1/%2").arg(m_documentId).arg(page);
+}
+
+QSizeF PdfPageModel::pageSize(int page) const
+{
+    if (page < 0 || page >= m_pageSizes.size())
+        return QSizeF();
+    return m_pageSizes.at(page);
+}
+
+qreal PdfPageModel::aspectRatio(int page) const
+{
+    const QSizeF size = pageSize(page);
+    return (size.height() > 0) ? size.width() / size.height() : 1.0;
+}
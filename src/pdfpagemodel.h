@@ -0,0 +1,60 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef PDFPAGEMODEL_H
+#define PDFPAGEMODEL_H
+
+#include <QAbstractListModel>
+#include <QSizeF>
+#include <QVector>
+
+// The pages of a document, for the page views. Backed by the page sizes
+// collected while loading, shared with PdfManager, so creating it costs the
+// same for any page count: roles are computed when the view asks for them.
+class PdfPageModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(int documentId READ documentId CONSTANT)
+    Q_PROPERTY(int count READ count CONSTANT)
+public:
+    enum Roles {
+        ImageRole = Qt::UserRole + 1,
+        PageNumberRole,
+        DocumentIdRole,
+        PageWidthRole,
+        PageHeightRole,
+        PageAspectRatioRole
+    };
+    Q_ENUM(Roles)
+
+    PdfPageModel(int documentId, const QVector<QSizeF> &pageSizes, QObject *parent = nullptr);
+
+    int documentId() const;
+    int count() const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    // Same as the roles, for use outside delegates
+    Q_INVOKABLE QString imageSource(int page) const;
+    Q_INVOKABLE QSizeF pageSize(int page) const;
+    Q_INVOKABLE qreal aspectRatio(int page) const;
+
+private:
+    const int m_documentId;
+    const QVector<QSizeF> m_pageSizes;
+};
+
+#endif // PDFPAGEMODEL_H
@@ -451,10 +451,39 @@ Rectangle {
         printMargins()
     }
 
+    function _modeString() {
+        if (root._mode == PageCropper.MarginsMode.Even_Odd)
+            return "eo"
+        if (root._mode == PageCropper.MarginsMode.Individual)
+            return "i"
+        return "s"
+    }
+
+    AutoCropper {
+        id: autoCropper
+        onFinished: {
+            if (documentId !== root.documentId || margins.length !== root.pageCount)
+                return
+            root._margins = margins
+            root.changePageIndex(root.pageIndex)
+        }
+    }
+
     Column {
         anchors.left: parent.left
         anchors.bottom: parent.bottom
         spacing: 2
+        Controls.Button {
+            text: (autoCropper.running)
+                  ? qsTr("Detecting... ") + Math.round(autoCropper.progress * 100) + "%"
+                  : qsTr("Auto")
+            onClicked: {
+                if (autoCropper.running)
+                    autoCropper.cancel()
+                else
+                    autoCropper.analyze(root.documentId, root._modeString())
+            }
+        }
         Controls.RadioButton {
             checked: true
             text: qsTr("Single")
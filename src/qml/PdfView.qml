@@ -71,7 +71,8 @@ Rectangle {
         setRasterWidth(pdfView.width)
     }
 
-    property var documentModel : []
+    // PdfPageModel of the document, null when none is open
+    property var documentModel : null
     // This object needs contentX, contentY, contentWidth and currentIndex
     property var currentView: pagesView
 
@@ -82,7 +83,8 @@ Rectangle {
         defaultSuffix: "pdf"
         onAccepted: {
             if (pdfView.documentId >= 0) {
-                pdfView.documentModel = []
+                pdfView.documentModel = null
+                pdfView.search("")
                 pdfManager.closeDocument(pdfView.documentId)
                 pdfView.documentId = -1
                 pdfView.pageCount = 0
@@ -95,16 +97,60 @@ Rectangle {
 
     property var pageSize: Qt.size(0,0)
     property bool invert: false
+    // PdfManager.Color, PdfManager.Grayscale or PdfManager.AutoGrayscale
+    property int colorMode: PdfManager.Color
     property real pdfWidth: 0
     property real scaleFactor: pdfWidth / pdfView.width
+    // When rasterizing wider than the view, pages are drawn as a backdrop at
+    // view width plus high resolution tiles covering only the visible area
+    property bool tiled: pdfWidth > pdfView.width
+    property int tileSize: 512
     property string documentPath
+    // Of the document being opened, -1 when none is
+    property real loadProgress: -1
+    property int loadingDocumentId: -1
 
     property alias zoom: pageGestureHandler.scale
     property real scale: 1.0
     property real dpr: 1.0
 
     onScaleChanged: {
-        setFlickableWidth(pdfView.width * zoom) // will refocus on release
+        setFlickableWidth(pdfView.width * scale) // will refocus on release
+    }
+
+    // While pinching, the delegates are only transformed, scaling the textures
+    // they have about pinchOrigin (in content coordinates). Layout and rasters
+    // are updated once, when the gesture ends.
+    property bool pinching: false
+    property real pinchScale: 1.0
+    property point pinchOrigin: Qt.point(0, 0)
+    property point pinchTranslation: Qt.point(0, 0)
+    property point pinchStartCentroid: Qt.point(0, 0)
+
+    function beginPinch(centroid) {
+        pinchOrigin = Qt.point(pagesView.contentX + centroid.x,
+                               pagesView.contentY + centroid.y)
+        pinchStartCentroid = centroid
+        pinchTranslation = Qt.point(0, 0)
+        pinchScale = 1.0
+        pinching = true
+    }
+
+    function endPinch() {
+        pinching = false
+        pdfView.scale = pageGestureHandler.scale
+        pinchScale = 1.0
+        pinchTranslation = Qt.point(0, 0)
+        pagesView.forceLayout()
+        pageGestureHandler.adjustXY()
+    }
+
+    // Re-rasterizes at the new zoom once it stops changing
+    Timer {
+        id: refocusTimer
+        interval: 300
+        repeat: false
+        onTriggered: pdfView.refocus()
     }
 
     property alias contentX: pagesView.contentX
@@ -114,8 +160,65 @@ Rectangle {
     property int bytesCount: 0
     property string fileName
     property alias contentWidth: pagesView.contentWidth
+    property alias renderMetrics: pdfManager.renderMetrics
+    // image://pdfthumbs/<documentId>/<page> became available
+    signal thumbnailReady(int documentId, int page)
+    function resetRenderMetrics() {
+        pdfManager.resetRenderMetrics()
+    }
     property alias currentIndex: pagesView.currentIndex
 
+    // In-document search, answered by the text index of the document once
+    // built (textIndexed)
+    property bool textIndexed: false
+    property string searchQuery
+    property var searchHits: []
+    property int currentHit: -1
+    // Hits grouped by page, for the highlights
+    property var _pageHits: ({})
+
+    function search(query) {
+        searchQuery = query
+        var hits = (query.length && documentId >= 0) ? pdfManager.search(documentId, query) : []
+        var byPage = {}
+        for (var i = 0; i < hits.length; i++) {
+            var page = hits[i].page
+            if (!byPage[page])
+                byPage[page] = []
+            byPage[page].push(hits[i])
+        }
+        _pageHits = byPage
+        searchHits = hits
+        currentHit = -1
+        // The first hit from the page being read on
+        var current = indexAt(contentY)
+        for (var h = 0; h < hits.length; h++) {
+            if (hits[h].page >= current) {
+                goToHit(h)
+                return
+            }
+        }
+        if (hits.length)
+            goToHit(0)
+    }
+
+    function goToHit(idx) {
+        if (!searchHits.length)
+            return
+        currentHit = (idx + searchHits.length) % searchHits.length
+        if (pagesView.indexAt(pdfView.width * 0.5, pdfView.contentY + pdfView.height * 0.5)
+                !== searchHits[currentHit].page)
+            goToPage(searchHits[currentHit].page)
+    }
+
+    function nextHit() {
+        goToHit(currentHit + 1)
+    }
+
+    function previousHit() {
+        goToHit(currentHit - 1)
+    }
+
     // needed to update the margins atomically
     // Intended as left,right,top,bottom
     // in percentage.
@@ -139,8 +242,33 @@ Rectangle {
              + "]"
     }
 
+    // The image requested by the delegate of page idx. Shared with the prefetcher,
+    // so that what it renders is found in the cache.
+    function pageSource(idx) {
+        if (!documentModel || idx < 0 || idx >= documentModel.count)
+            return ""
+        return documentModel.imageSource(idx) + "/" + _marginString(idx) + "/pagesViewDelegate"
+                + _colorModeString()
+    }
+
+    function _colorModeString() {
+        if (colorMode === PdfManager.Grayscale)
+            return "/grayscale"
+        if (colorMode === PdfManager.AutoGrayscale)
+            return "/autograyscale"
+        return ""
+    }
+
+    function pageSourceSize(idx) {
+        if (!documentModel || idx < 0 || idx >= documentModel.count)
+            return Qt.size(0, 0)
+        var baseWidth = (pdfView.tiled) ? pdfView.width : pdfWidth
+        return Qt.size(Math.floor(baseWidth),
+                       Math.floor(baseWidth / documentModel.aspectRatio(idx)))
+    }
+
     function currentImageSource() {
-        if (!documentModel.documentModel)
+        if (!documentModel)
             return ""
         return pagesView.itemAt(0, pdfView.contentY).imageSource;
     }
@@ -153,12 +281,36 @@ Rectangle {
         return pagesView.itemAt(x, y);
     }
 
+    function goToPage(idx) {
+        if (idx < 0 || idx >= pagesView.count)
+            return
+        pagesView.positionViewAtIndex(idx, ListView.Beginning)
+    }
+
+    // Tells the renderer which pages are on screen, so that they go first
+    function updateViewport() {
+        if (pdfView.documentId < 0)
+            return
+        var first = pagesView.indexAt(pagesView.contentX, pagesView.contentY)
+        if (first < 0) // on a page delimiter
+            first = pagesView.indexAt(pagesView.contentX, pagesView.contentY + 2)
+        var last = pagesView.indexAt(pagesView.contentX, pagesView.contentY + pagesView.height - 1)
+        if (last < 0)
+            last = (first < 0) ? -1 : pdfView.pageCount - 1
+        if (first < 0)
+            first = last
+        if (first < 0)
+            return
+        pdfManager.setViewport(pdfView.documentId, first, last)
+    }
+
     signal doubleTap
     onDocumentPathChanged: {
 
         var cleanPath = documentPath.replace(/^(file:\/{2})/,"");
         console.log("PdfView -- ","PdfManager: Loading", cleanPath)
-        pdfManager.openDocument(cleanPath)
+        pdfView.loadProgress = 0
+        pdfView.loadingDocumentId = pdfManager.openDocument(cleanPath)
     }
 
     function printDebug()
@@ -171,9 +323,32 @@ Rectangle {
 
     PdfManager {
         id: pdfManager
+        onThumbnailReady: pdfView.thumbnailReady(documentId, page)
+        onTextIndexReady: {
+            if (documentId !== pdfView.documentId)
+                return
+            pdfView.textIndexed = true
+            if (pdfView.searchQuery.length) // typed while indexing
+                pdfView.search(pdfView.searchQuery)
+        }
+        onLoadProgress: {
+            if (documentId === pdfView.loadingDocumentId)
+                pdfView.loadProgress = progress
+        }
+        onLoadFailed: {
+            console.warn("PdfView -- cannot open document", documentId, error)
+            if (documentId === pdfView.loadingDocumentId) {
+                pdfView.loadingDocumentId = -1
+                pdfView.loadProgress = -1
+            }
+        }
 
         onReady: {
             console.log("PdfView -- onReady","document ",documentId, "ready")
+            if (documentId === pdfView.loadingDocumentId) {
+                pdfView.loadingDocumentId = -1
+                pdfView.loadProgress = -1
+            }
             pdfView.documentId = documentId;
             pdfView.pageCount = pdfManager.pageCount(documentId)
             pdfView.bytesCount = pdfManager.bytesCount(documentId)
@@ -189,12 +364,39 @@ Rectangle {
             }
 
             pdfView.documentModel = pdfManager.pages(documentId)
+            pdfView.textIndexed = pdfManager.isTextIndexed(documentId)
+            pdfView.search(pdfView.searchQuery)
             console.log("SZ:",sz.width, sz.height)
         }
         Component.onCompleted: {
         }
     }
 
+    // Opening progress. The view stays interactive meanwhile
+    Rectangle {
+        id: loadProgressBar
+        visible: pdfView.loadProgress >= 0
+        anchors {
+            top: parent.top
+            left: parent.left
+        }
+        z: 1
+        height: 4 * pdfView.dpr
+        width: pdfView.width * Math.max(0.02, pdfView.loadProgress)
+        color: "steelblue"
+    }
+
+    PagePrefetcher {
+        id: prefetcher
+        target: pagesView
+        count: pdfView.pageCount
+        enabled: pdfView.documentId >= 0 && pagesView.enabled
+        request: function(idx) {
+            return { "source": pdfView.pageSource(idx),
+                     "sourceSize": pdfView.pageSourceSize(idx) }
+        }
+    }
+
     ListView {
         id: pagesView;
         enabled: pdfView.viewMode == PdfView.ViewMode.Continuous1Up
@@ -216,17 +418,33 @@ Rectangle {
 //        }
 
         delegate: Column {
+            id: pageDelegate
             spacing: 0
-            property real cropped_ar: page1up.croppedAR(modelData.page_ar)
+            property real cropped_ar: page1up.croppedAR(model.page_ar)
+            transform: [
+                Scale {
+                    origin.x: pdfView.pinchOrigin.x - pageDelegate.x
+                    origin.y: pdfView.pinchOrigin.y - pageDelegate.y
+                    xScale: pdfView.pinchScale
+                    yScale: pdfView.pinchScale
+                },
+                Translate {
+                    x: pdfView.pinchTranslation.x
+                    y: pdfView.pinchTranslation.y
+                }
+            ]
             FlickerlessImage {
                 id: page1up
                 //            anchors.fill: parent
                 //            asynchronous: false
                 invert: pdfView.invert
                 cache: false
+                progressive: true
+                reloadOffscreen: false
                 smooth: width !== sourceSize.width // defaults to true
-                property string imageSource: modelData.image
-                source: modelData.image + "/" + pdfView._marginString(index) + "/pagesViewDelegate"
+                property string imageSource: model.image
+                property int pageIndex: index
+                source: pdfView.pageSource(index)
 
                 width: pagesView.contentWidth // contentWidth is the same for all pages
                 height: pagesView.contentWidth / cropped_ar
@@ -237,8 +455,48 @@ Rectangle {
                                   : ar
                 }
 
-                sourceSize.width: pdfWidth
-                sourceSize.height: pdfWidth / modelData.page_ar
+                sourceSize: pdfView.pageSourceSize(index)
+
+                tileSize: (pdfView.tiled) ? pdfView.tileSize : 0
+                tileRasterSize: Qt.size(pdfWidth, pdfWidth / model.page_ar)
+                viewport: Qt.rect(pagesView.contentX - parent.x,
+                                  pagesView.contentY - parent.y,
+                                  pagesView.width,
+                                  pagesView.height)
+
+                // Search hits on this page. Their rectangles are resolved in
+                // the background, hitRectsRevision counts the ones delivered
+                property int hitRectsRevision: 0
+                Connections {
+                    target: pdfManager
+                    onSearchHitRectsReady: {
+                        if (documentId === pdfView.documentId && page === page1up.pageIndex)
+                            page1up.hitRectsRevision++
+                    }
+                }
+                Repeater {
+                    model: pdfView._pageHits[page1up.pageIndex] || []
+                    Repeater {
+                        id: hitRects
+                        property var hit: modelData
+                        property bool current: pdfView.currentHit >= 0
+                                               && pdfView.searchHits[pdfView.currentHit] === hit
+                        model: {
+                            page1up.hitRectsRevision
+                            return pdfManager.searchHitRects(pdfView.documentId, hit.page, hit.start, hit.length)
+                        }
+                        Rectangle {
+                            // Rects are normalized to the uncropped page
+                            property vector4d mrgs: pdfView._margins(page1up.pageIndex)
+                            x: (modelData.x - mrgs.x) / (1.0 - mrgs.x - mrgs.z) * page1up.width
+                            y: (modelData.y - mrgs.y) / (1.0 - mrgs.y - mrgs.w) * page1up.height
+                            width: modelData.width / (1.0 - mrgs.x - mrgs.z) * page1up.width
+                            height: modelData.height / (1.0 - mrgs.y - mrgs.w) * page1up.height
+                            color: (hitRects.current) ? "orange" : "yellow"
+                            opacity: 0.4
+                        }
+                    }
+                }
 
 //                Component.onCompleted: {
 //                     console.log("PdfView -- ",modelData, modelData.image, modelData.page_width, modelData.page_height, pagesView.contentWidth)
@@ -315,6 +573,21 @@ Rectangle {
             property int currentIndex: 0
 
             function zoom() {
+                if (active && !wheeled) {
+                    // Pinch: the anchor is taken once, on the layout at the
+                    // beginning of the gesture, which stays until it ends
+                    if (!pdfView.pinching) {
+                        setAnchor()
+                        pdfView.beginPinch(centroid)
+                    }
+                    pdfView.pinchScale = scale / pdfView.scale
+                    return
+                }
+                setAnchor()
+                pdfView.scale = scale
+            }
+
+            function setAnchor() {
                 var pt = Qt.point(pagesView.contentX+centroid.x,
                                   pagesView.contentY+centroid.y)
                 var itm = pagesView.itemAt(pt.x, pt.y)
@@ -326,7 +599,6 @@ Rectangle {
                                                      (pt.y - itmPos.y) / itm.height )
 //                console.log("CI: ", currentIndex)
 //                console.log("PosInPg:", normalizedPositionInPage, centroid)
-                pdfView.scale = scale
             }
 
             onScaleChanged: {
@@ -338,12 +610,17 @@ Rectangle {
                     pinchCentroid.show(centroid)
                 } else {
                     pinchCentroid.hide()
-                    pdfView.refocus()
+                    if (pdfView.pinching)
+                        pdfView.endPinch()
+                    refocusTimer.restart()
                 }
             }
 
             onCentroidChanged: {
                 pinchCentroid.move(centroid)
+                if (pdfView.pinching)
+                    pdfView.pinchTranslation = Qt.point(centroid.x - pdfView.pinchStartCentroid.x,
+                                                        centroid.y - pdfView.pinchStartCentroid.y)
             }
 
             function adjustXY() {
@@ -356,7 +633,11 @@ Rectangle {
             }
         }
 
+        onContentYChanged: pdfView.updateViewport()
+        onHeightChanged: pdfView.updateViewport()
+
         onContentHeightChanged: {
+            pdfView.updateViewport()
             // called asynchronously after scale has been set onto pagesView
             if (!pageGestureHandler.active && !pageGestureHandler.wheeled) {
                 return
@@ -0,0 +1,107 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+import QtQuick 2.13
+
+// Debug overlay for PdfManager.renderMetrics
+Rectangle {
+    id: overlay
+    property var metrics: ({})
+    property var phases: ["queueWait", "render", "crop", "textureFactory", "firstFrame"]
+    property real dpr: 1.0
+    signal reset
+
+    color: Qt.rgba(0, 0, 0, 0.7)
+    radius: 6 * dpr
+    width: content.width + 20 * dpr
+    height: content.height + 20 * dpr
+
+    function fmt(v) {
+        return (v === undefined) ? "-" : v.toFixed(1)
+    }
+
+    Column {
+        id: content
+        x: 10 * overlay.dpr
+        y: 10 * overlay.dpr
+        spacing: 4 * overlay.dpr
+
+        Text {
+            color: "white"
+            font.pixelSize: 12 * overlay.dpr
+            font.family: "Monospace"
+            text: {
+                var c = overlay.metrics["counters"]
+                if (!c)
+                    return ""
+                return "requests " + c.requests
+                        + "  mem hits " + c.memoryCacheHits
+                        + "  disk hits " + c.diskCacheHits
+                        + "  renders " + c.renders
+                        + "  cancelled " + c.cancelled
+                        + "  prefetches " + c.prefetches
+            }
+        }
+
+        Repeater {
+            model: overlay.phases
+            Row {
+                spacing: 8 * overlay.dpr
+                property var phase: overlay.metrics[modelData] || ({})
+                property real peak: Math.max.apply(null, (phase.histogram || [0]).concat([1]))
+                Text {
+                    width: 110 * overlay.dpr
+                    color: "white"
+                    font.pixelSize: 12 * overlay.dpr
+                    font.family: "Monospace"
+                    text: modelData
+                }
+                Text {
+                    width: 290 * overlay.dpr
+                    color: "white"
+                    font.pixelSize: 12 * overlay.dpr
+                    font.family: "Monospace"
+                    text: "n " + (phase.count || 0)
+                          + "  p50 " + overlay.fmt(phase.p50_ms)
+                          + "  p95 " + overlay.fmt(phase.p95_ms)
+                          + "  max " + overlay.fmt(phase.max_ms) + " ms"
+                }
+                // One bar per bucket: <1ms, <2ms, ..., above 1s
+                Row {
+                    anchors.bottom: parent.bottom
+                    spacing: 1
+                    Repeater {
+                        model: phase.histogram || []
+                        Rectangle {
+                            anchors.bottom: parent.bottom
+                            width: 6 * overlay.dpr
+                            height: Math.max(1, 14 * overlay.dpr * modelData / peak)
+                            color: "tomato"
+                        }
+                    }
+                }
+            }
+        }
+
+        Text {
+            color: "lightsteelblue"
+            font.pixelSize: 12 * overlay.dpr
+            text: "reset"
+            MouseArea {
+                anchors.fill: parent
+                onClicked: overlay.reset()
+            }
+        }
+    }
+}
@@ -217,6 +217,32 @@ Window {
 //        anchors.fill: parent
 //    }
 
+    Shortcut {
+        sequence: "Ctrl+M"
+        onActivated: {
+            metricsOverlay.visible = !metricsOverlay.visible
+        }
+    }
+
+    Shortcut {
+        sequence: StandardKey.Find
+        onActivated: {
+            toolbar.visible = true
+            searchField.forceActiveFocus()
+            searchField.selectAll()
+        }
+    }
+
+    Shortcut {
+        sequence: StandardKey.FindNext
+        onActivated: pdfView.nextHit()
+    }
+
+    Shortcut {
+        sequence: StandardKey.FindPrevious
+        onActivated: pdfView.previousHit()
+    }
+
     Shortcut {
         sequence: "Ctrl+P"
         onActivated: {
@@ -405,6 +431,71 @@ Window {
                         }
                     }
 
+                    Controls.Button {
+                        text: (pdfView.colorMode === PdfManager.Grayscale) ? "Gray"
+                              : (pdfView.colorMode === PdfManager.AutoGrayscale) ? "Auto gray"
+                                                                                 : "Color"
+                        Layout.alignment: Qt.AlignHCenter
+                        font.pixelSize: qdfContext.dynamicProperties.menuButtonFontSize
+                        onClicked: {
+                            // Color -> AutoGrayscale -> Grayscale -> Color
+                            if (pdfView.colorMode === PdfManager.Color)
+                                pdfView.colorMode = PdfManager.AutoGrayscale
+                            else if (pdfView.colorMode === PdfManager.AutoGrayscale)
+                                pdfView.colorMode = PdfManager.Grayscale
+                            else
+                                pdfView.colorMode = PdfManager.Color
+                        }
+                    }
+
+                    Controls.Button {
+                        text: "Pages"
+                        Layout.alignment: Qt.AlignHCenter
+                        font.pixelSize: qdfContext.dynamicProperties.menuButtonFontSize
+                        onClicked: {
+                            toolbar.visible = false
+                            overview.documentId = pdfView.documentId
+                            pageStack.push(overviewFrame)
+                            overviewFrame.enabled = overviewFrame.visible = true
+                            // Start around the page being read
+                            var r = overview.pageRect(pdfView.indexAt(pdfView.contentY))
+                            overviewFlickable.contentY = Math.max(0,
+                                Math.min(r.y - overviewFlickable.height * 0.5,
+                                         overviewFlickable.contentHeight - overviewFlickable.height))
+                        }
+                    }
+
+                    Controls.TextField {
+                        id: searchField
+                        Layout.alignment: Qt.AlignHCenter
+                        Layout.preferredWidth: 160 * qdfContext.dpr
+                        font.pixelSize: qdfContext.dynamicProperties.menuButtonFontSize
+                        placeholderText: (pdfView.textIndexed || pdfView.documentId < 0)
+                                         ? "Search" : "Indexing..."
+                        selectByMouse: true
+                        onTextEdited: searchTimer.restart()
+                        onAccepted: {
+                            if (pdfView.searchQuery !== text)
+                                pdfView.search(text)
+                            else
+                                pdfView.nextHit()
+                        }
+                        // Results follow typing, without a search per keystroke
+                        Timer {
+                            id: searchTimer
+                            interval: 150
+                            onTriggered: pdfView.search(searchField.text)
+                        }
+                    }
+
+                    Controls.Label {
+                        visible: pdfView.searchQuery.length > 0
+                        Layout.alignment: Qt.AlignHCenter
+                        font.pixelSize: qdfContext.dynamicProperties.menuButtonFontSize
+                        color: qdfContext._TEXT_COLOR
+                        text: (pdfView.currentHit + 1) + "/" + pdfView.searchHits.length
+                    }
+
                     Controls.Button {
                         text: "Crop"
                         Layout.alignment: Qt.AlignHCenter
@@ -437,9 +528,121 @@ Window {
             ]
 
 
+            // Thumbnail of the page being read, and the part of it on screen,
+            // while zoomed in
+            Rectangle {
+                id: miniMap
+                property int page: (pdfView.documentId < 0)
+                                   ? -1
+                                   : pdfView.indexAt(pdfView.contentY, pdfView.contentX)
+                property var pageItem: (page < 0) ? null : pdfView.itemAt(pdfView.contentY, pdfView.contentX)
+                property int revision: 0 // reloads the thumbnail once generated
+                visible: pdfView.zoom > 1 && page >= 0 && miniMapImage.status === Image.Ready
+                anchors {
+                    right: parent.right
+                    bottom: parent.bottom
+                    margins: 10 * qdfContext.dpr
+                }
+                width: 120 * qdfContext.dpr
+                height: miniMapImage.paintedHeight
+                color: "white"
+                border.color: "gray"
+                clip: true
+
+                Connections {
+                    target: pdfView
+                    onThumbnailReady: {
+                        if (documentId === pdfView.documentId && page === miniMap.page)
+                            miniMap.revision++
+                    }
+                }
+
+                Image {
+                    id: miniMapImage
+                    width: parent.width
+                    fillMode: Image.PreserveAspectFit
+                    asynchronous: true
+                    cache: false
+                    source: (miniMap.page < 0)
+                            ? ""
+                            : "image://pdfthumbs/" + pdfView.documentId + "/" + miniMap.page
+                              + "/" + miniMap.revision
+                }
+                Rectangle {
+                    color: "transparent"
+                    border.color: "firebrick"
+                    border.width: 2 * qdfContext.dpr
+                    x: miniMap.width * pdfView.contentX / Math.max(1, pdfView.contentWidth)
+                    width: miniMap.width * pdfView.width / Math.max(1, pdfView.contentWidth)
+                    y: (miniMap.pageItem)
+                       ? miniMap.height * (pdfView.contentY - miniMap.pageItem.y) / miniMap.pageItem.height
+                       : 0
+                    height: (miniMap.pageItem)
+                            ? miniMap.height * pdfView.height / miniMap.pageItem.height
+                            : 0
+                }
+            }
         } // Rectangle // pdf container
     } // Rectangle // stackview frame
 
+    Rectangle {
+        id: overviewFrame
+        color: (pdfView.invert) ? "black" : "gray"
+        enabled: false
+        visible: false
+        objectName: "overviewFrame"
+
+        function close() {
+            pageStack.pop()
+            overviewFrame.enabled = overviewFrame.visible = false
+        }
+
+        Flickable {
+            id: overviewFlickable
+            rotation: uiRotation
+            transformOrigin: Item.Center
+            anchors.centerIn: parent
+            property var orientation: win.appOrientation
+            width: (orientation === Qt.Horizontal) ? parent.width : parent.height
+            height: (orientation === Qt.Horizontal) ? parent.height : parent.width
+            clip: true
+            contentWidth: width
+            contentHeight: overview.implicitHeight
+            boundsBehavior: Flickable.StopAtBounds
+
+            PageOverview {
+                id: overview
+                width: overviewFlickable.width
+                height: implicitHeight
+                thumbnailWidth: 120 * qdfContext.dpr
+                spacing: 8 * qdfContext.dpr
+                invert: pdfView.invert
+                viewport: Qt.rect(overviewFlickable.contentX, overviewFlickable.contentY,
+                                  overviewFlickable.width, overviewFlickable.height)
+                MouseArea {
+                    anchors.fill: parent
+                    onClicked: {
+                        var idx = overview.pageAt(mouse.x, mouse.y)
+                        if (idx < 0)
+                            return
+                        overviewFrame.close()
+                        pdfView.goToPage(idx)
+                    }
+                }
+            }
+        }
+
+        ArrowButton {
+            anchors {
+                left: parent.left
+                top: parent.top
+                leftMargin: 12 * qdfContext.dpr
+                topMargin: 12 * qdfContext.dpr
+            }
+            onClicked: overviewFrame.close()
+        }
+    }
+
     Rectangle {
         id: cropperFrame
         color: "transparent"
@@ -512,15 +715,17 @@ Window {
             console.log(currentItem.objectName)
         }
     } // StackView
-//    Image {
-//        id: miniMap
-//        anchors.bottom: parent.bottom
-//        anchors.right: parent.right
-//        width: 200
-//        height: 200
-//        sourceSize: (pdfView.pageSize !== undefined)
-//                    ? pdfView.pageSize
-//                    : Qt.size(100,100)
-//        source: "file:///home/user/black.jpeg"
-//    }
+    RenderMetricsOverlay {
+        id: metricsOverlay
+        visible: false
+        anchors {
+            left: parent.left
+            bottom: parent.bottom
+            margins: 10 * qdfContext.dpr
+        }
+        dpr: qdfContext.dpr
+        metrics: (visible) ? pdfView.renderMetrics : ({})
+        onReset: pdfView.resetRenderMetrics()
+    }
+
 }
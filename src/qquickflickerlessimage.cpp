@@ -15,6 +15,10 @@ In addition to the above,
 #include "qquickflickerlessimage.h"
 #include <QtCore/qmath.h>
 #include <QVector4D>
+#include "rendermetrics.h"
+#include "tracelog.h"
+#include "pagetexture.h"
+#include "imagememorygovernor.h"
 
 #include <QtGui/qguiapplication.h>
 #include <QtGui/qscreen.h>
@@ -864,9 +868,14 @@ void QQuickImage::setMipmap(bool use)
 QSGNode *QQuickFlickerlessImage::updatePaintNode(QSGNode *oldNode, QQuickItem::UpdatePaintNodeData *)
 {
     Q_D(QQuickFlickerlessImage);
+    TraceScope trace("scenegraph", "QQuickFlickerlessImage::updatePaintNode");
 
     QQuickPixmap *pix = d->pix;
-    QSGTexture *texture = d->sceneGraphRenderContext()->textureForFactory(pix->textureFactory(), window());
+    QSGTexture *texture = nullptr;
+    {
+        TraceScope textureTrace("scenegraph", "textureForFactory");
+        texture = d->sceneGraphRenderContext()->textureForFactory(pix->textureFactory(), window());
+    }
 
     // Copy over the current texture state into the texture provider...
     if (d->provider) {
@@ -880,6 +889,12 @@ QSGNode *QQuickFlickerlessImage::updatePaintNode(QSGNode *oldNode, QQuickItem::U
         return nullptr;
     }
 
+    if (m_firstFramePending && d->pix->isReady() && d->pix->url() == d->url) {
+        // Not a placeholder, nor the previous source
+        m_firstFramePending = false;
+        RenderMetrics::instance().record(RenderMetrics::FirstFrame, m_loadTimer.nsecsElapsed());
+    }
+
     QSGDefaultInternalImageNodePlus *node = static_cast<QSGDefaultInternalImageNodePlus *>(oldNode);
 //    QSGInternalImageNode *node = static_cast<QSGInternalImageNode *>(oldNode);
     if (!node) {
@@ -1012,9 +1027,326 @@ QSGNode *QQuickFlickerlessImage::updatePaintNode(QSGNode *oldNode, QQuickItem::U
     node->setAntialiasing(d->antialiasing);
     node->update();
 
+    updateTileNodes(node);
+
     return node;
 }
 
+void QQuickFlickerlessImage::updateTileNodes(QSGNode *parentNode)
+{
+    Q_D(QQuickFlickerlessImage);
+
+    QVector<QPair<FlickerlessImageTile *, QSGTexture *>> readyTiles;
+    if (d->tileGrid.isValid()) {
+        for (FlickerlessImageTile *t: qAsConst(d->tiles)) {
+            if (!t->pix.isReady())
+                continue;
+            QSGTexture *texture = d->sceneGraphRenderContext()->textureForFactory(t->pix.textureFactory(), window());
+            if (texture)
+                readyTiles.append(qMakePair(t, texture));
+        }
+    }
+
+    while (parentNode->childCount() > readyTiles.size()) {
+        QSGNode *child = parentNode->lastChild();
+        parentNode->removeChildNode(child);
+        delete child;
+    }
+
+    const qreal sx = width() / d->tileGrid.width();
+    const qreal sy = height() / d->tileGrid.height();
+    QSGNode *child = parentNode->firstChild();
+    for (const auto &t: qAsConst(readyTiles)) {
+        QSGDefaultInternalImageNodePlus *tileNode = static_cast<QSGDefaultInternalImageNodePlus *>(child);
+        if (!tileNode) {
+            tileNode = new QSGDefaultInternalImageNodePlus(static_cast<QSGDefaultRenderContext *>(d->sceneGraphRenderContext()));
+            parentNode->appendChildNode(tileNode);
+        }
+        child = tileNode->nextSibling();
+
+        if (tileNode->materialTexture() != t.second)
+            tileNode->setTexture(t.second);
+        tileNode->setUniforms(m_uniforms);
+        const QRect &r = t.first->rect;
+        const QRectF targetRect(r.x() * sx, r.y() * sy, r.width() * sx, r.height() * sy);
+        tileNode->setMipmapFiltering(QSGTexture::None);
+        tileNode->setHorizontalWrapMode(QSGTexture::ClampToEdge);
+        tileNode->setVerticalWrapMode(QSGTexture::ClampToEdge);
+        tileNode->setFiltering(d->smooth ? QSGTexture::Linear : QSGTexture::Nearest);
+        tileNode->setTargetRect(targetRect);
+        tileNode->setInnerTargetRect(targetRect);
+        tileNode->setSubSourceRect(QRectF(0, 0, 1, 1));
+        tileNode->setMirror(d->mirror);
+        tileNode->setAntialiasing(d->antialiasing);
+        tileNode->update();
+    }
+}
+
+namespace {
+const qreal kPreviewScale = 0.25;
+
+qint64 pixmapBytes(const QQuickPixmap &pix)
+{
+    QQuickTextureFactory *factory = pix.textureFactory();
+    return (factory) ? factory->textureByteCount() : 0;
+}
+} // namespace
+
+QQuickFlickerlessImage::~QQuickFlickerlessImage()
+{
+    ImageMemoryGovernor::instance().remove(this);
+}
+
+void QQuickFlickerlessImage::load()
+{
+    Q_D(QQuickFlickerlessImage);
+    if (!m_reloadOffscreen && isComponentComplete() && !d->pix->isNull() && !isOnScreen()) {
+        m_reloadPending = true;
+        return;
+    }
+    m_reloadPending = false;
+    m_firstFramePending = !d->url.isEmpty();
+    m_loadTimer.start();
+    QQuickImage::load();
+    loadPreview();
+    m_memoryLevel = Full;
+    updateTiles();
+}
+
+// Without a viewport, everything is considered on screen
+bool QQuickFlickerlessImage::isOnScreen() const
+{
+    if (m_viewport.isEmpty())
+        return true;
+    return m_viewport.intersects(QRectF(0, 0, width(), height()));
+}
+
+qreal QQuickFlickerlessImage::viewportDistance() const
+{
+    if (m_viewport.isEmpty())
+        return 0;
+    const qreal dx = qMax(0.0, qMax(m_viewport.left() - width(), -m_viewport.right()));
+    const qreal dy = qMax(0.0, qMax(m_viewport.top() - height(), -m_viewport.bottom()));
+    return qMax(dx, dy);
+}
+
+void QQuickFlickerlessImage::reduceMemory(MemoryLevel level)
+{
+    Q_D(QQuickFlickerlessImage);
+    if (level <= m_memoryLevel)
+        return;
+    m_memoryLevel = level;
+    clearTiles();
+    d->preview.clear(this);
+    d->pixLoading->clear(this); // reloaded once on screen anyway
+    d->pix->clear(this);
+    if (level == Reduced && m_progressive && d->sourcesize.isValid() && !d->url.isEmpty()) {
+        // Same placeholder shown while loading in progressive mode
+        const QSize previewSize = (QSizeF(d->sourcesize) * d->devicePixelRatio * kPreviewScale).toSize()
+                .expandedTo(QSize(1, 1));
+        d->pix->load(qmlEngine(this),
+                     QUrl(d->url.toString() + QStringLiteral("/preview")),
+                     QRect(),
+                     previewSize,
+                     QQuickPixmap::Asynchronous,
+                     d->providerOptions);
+        if (d->pix->isLoading())
+            d->pix->connectFinished(this, SLOT(reducedRequestFinished()));
+    }
+    pixmapChange();
+}
+
+void QQuickFlickerlessImage::reducedRequestFinished()
+{
+    pixmapChange();
+}
+
+void QQuickFlickerlessImage::pixmapChange()
+{
+    QQuickImage::pixmapChange();
+    reportMemory();
+}
+
+// The images stay referenced by the pixmaps once uploaded, so what is shown
+// counts twice, once per side
+void QQuickFlickerlessImage::reportMemory()
+{
+    Q_D(QQuickFlickerlessImage);
+    qint64 shown = pixmapBytes(*d->pix);
+    for (const FlickerlessImageTile *t: qAsConst(d->tiles))
+        shown += pixmapBytes(t->pix);
+    const qint64 loading = (d->pixLoading != d->pix) ? pixmapBytes(*d->pixLoading) : 0;
+    ImageMemoryGovernor::instance().setUsage(this, shown + loading, shown);
+}
+
+void QQuickFlickerlessImage::loadPreview()
+{
+    Q_D(QQuickFlickerlessImage);
+
+    d->preview.clear(this);
+    // Only worth it while the full image is loading, and when what is shown
+    // is not already the same source, at some other resolution, or the
+    // placeholder left by reduceMemory()
+    if (!m_progressive
+            || !d->pixLoading->isLoading()
+            || !d->sourcesize.isValid()
+            || m_memoryLevel == Reduced
+            || (!d->pix->isNull() && d->pix->url() == d->url))
+        return;
+
+    const QSize previewSize = (QSizeF(d->sourcesize) * d->devicePixelRatio * kPreviewScale).toSize()
+            .expandedTo(QSize(1, 1));
+    d->preview.load(qmlEngine(this),
+                    QUrl(d->url.toString() + QStringLiteral("/preview")),
+                    QRect(),
+                    previewSize,
+                    QQuickPixmap::Asynchronous,
+                    d->providerOptions);
+    if (d->preview.isLoading())
+        d->preview.connectFinished(this, SLOT(previewRequestFinished()));
+    else
+        previewRequestFinished();
+}
+
+void QQuickFlickerlessImage::previewRequestFinished()
+{
+    Q_D(QQuickFlickerlessImage);
+    if (d->preview.isReady() && d->pixLoading->isLoading()) {
+        // Stays until requestFinished() swaps in the full resolution image
+        d->pix->setPixmap(d->preview);
+        pixmapChange();
+        update();
+    }
+    d->preview.clear(this);
+}
+
+void QQuickFlickerlessImage::componentComplete()
+{
+    QQuickImage::componentComplete();
+    updateTiles();
+}
+
+void QQuickFlickerlessImage::geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry)
+{
+    QQuickImage::geometryChanged(newGeometry, oldGeometry);
+    if (newGeometry.size() != oldGeometry.size())
+        updateTiles();
+}
+
+void QQuickFlickerlessImage::clearTiles()
+{
+    Q_D(QQuickFlickerlessImage);
+    if (d->tiles.isEmpty())
+        return;
+    for (FlickerlessImageTile *t: qAsConst(d->tiles))
+        t->pix.clear(this);
+    qDeleteAll(d->tiles);
+    d->tiles.clear();
+    reportMemory();
+    update();
+}
+
+void QQuickFlickerlessImage::updateTiles()
+{
+    Q_D(QQuickFlickerlessImage);
+
+    // The tiles are cut from the cropped raster, which has the aspect ratio of the item
+    const QSize rasterSize = m_tileRasterSize * d->devicePixelRatio;
+    QSize grid;
+    if (width() > 0 && height() > 0 && rasterSize.width() > 0)
+        grid = QSize(rasterSize.width(), qCeil(rasterSize.width() * height() / width()));
+
+    const bool enabled = isComponentComplete()
+            && m_tileSize > 0
+            && !d->url.isEmpty()
+            && grid.isValid()
+            && m_tileRasterSize.width() > d->sourcesize.width();
+
+    if (!enabled
+            || d->tileUrl != d->url
+            || d->tileGrid != grid
+            || d->tileGridSize != m_tileSize) {
+        clearTiles();
+        d->tileUrl = d->url;
+        d->tileGrid = grid;
+        d->tileGridSize = m_tileSize;
+    }
+    if (!enabled)
+        return;
+
+    const QRectF visible = m_viewport.intersected(QRectF(0, 0, width(), height()));
+    if (visible.isEmpty()) {
+        clearTiles();
+        return;
+    }
+
+    const qreal scale = grid.width() / width();
+    const QRectF rasterVisible(visible.x() * scale, visible.y() * scale,
+                               visible.width() * scale, visible.height() * scale);
+    const int ts = m_tileSize;
+    const int cols = (grid.width() + ts - 1) / ts;
+    const int rows = (grid.height() + ts - 1) / ts;
+    const int c0 = qBound(0, int(rasterVisible.left() / ts), cols - 1);
+    const int c1 = qBound(0, int(qCeil(rasterVisible.right()) - 1) / ts, cols - 1);
+    const int r0 = qBound(0, int(rasterVisible.top() / ts), rows - 1);
+    const int r1 = qBound(0, int(qCeil(rasterVisible.bottom()) - 1) / ts, rows - 1);
+
+    // drop the tiles that left the viewport
+    bool changed = false;
+    for (auto it = d->tiles.begin(); it != d->tiles.end();) {
+        const int r = int(it.key() >> 32);
+        const int c = int(it.key() & 0xffffffff);
+        if (r < r0 || r > r1 || c < c0 || c > c1) {
+            it.value()->pix.clear(this);
+            delete it.value();
+            it = d->tiles.erase(it);
+            changed = true;
+        } else {
+            ++it;
+        }
+    }
+
+    QQuickPixmap::Options options = QQuickPixmap::Asynchronous;
+    if (d->cache)
+        options |= QQuickPixmap::Cache;
+    const QString baseUrl = d->url.toString();
+    for (int r = r0; r <= r1; ++r) {
+        for (int c = c0; c <= c1; ++c) {
+            const quint64 key = (quint64(r) << 32) | quint64(c);
+            if (d->tiles.contains(key))
+                continue;
+
+            FlickerlessImageTile *t = new FlickerlessImageTile;
+            t->rect = QRect(c * ts, r * ts, ts, ts).intersected(QRect(QPoint(0, 0), grid));
+            d->tiles.insert(key, t);
+            const QUrl tileUrl(baseUrl + QStringLiteral("/tile/")
+                               + QString::number(t->rect.x()) + QLatin1Char(',')
+                               + QString::number(t->rect.y()) + QLatin1Char(',')
+                               + QString::number(t->rect.width()) + QLatin1Char(',')
+                               + QString::number(t->rect.height()));
+            t->pix.load(qmlEngine(this),
+                        tileUrl,
+                        QRect(),
+                        rasterSize,
+                        options,
+                        d->providerOptions);
+            if (t->pix.isLoading())
+                t->pix.connectFinished(this, SLOT(tileRequestFinished()));
+            changed = true;
+        }
+    }
+    if (changed) {
+        reportMemory();
+        update();
+    }
+}
+
+void QQuickFlickerlessImage::tileRequestFinished()
+{
+    reportMemory();
+    update();
+}
+
 
 QSGMaterialType CoolTextureMaterialShader::type;
 QSGCoolTextureMaterial::QSGCoolTextureMaterial()
@@ -1039,6 +1371,9 @@ void CoolTextureMaterialShader::updateState(const QSGMaterialShader::RenderState
 
     QSGCoolTextureMaterial *m = static_cast<QSGCoolTextureMaterial *>(newEffect);
     program()->setUniformValue(m_invert_id, m->uniforms.invert);
+    // Grayscale pages come as single channel textures, expanded in the shader
+    const PageTexture *pageTexture = qobject_cast<PageTexture *>(m->texture());
+    program()->setUniformValue(m_luminance_id, pageTexture && pageTexture->isSingleChannel());
     if (oldEffect == nullptr) {
         //            // The viewport is constant, so set the pixel size uniform only once.
         //            QRect r = state.viewportRect();
@@ -1067,6 +1402,7 @@ const char * const *CoolTextureMaterialShader::attributeNames() const
 void CoolTextureMaterialShader::initialize()
 {
     m_invert_id = program()->uniformLocation("invert");
+    m_luminance_id = program()->uniformLocation("luminance");
     QSGOpaqueTextureMaterialShader::initialize();
 }
 
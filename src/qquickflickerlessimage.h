@@ -25,6 +25,7 @@ In addition to the above,
 #include <private/qsgmaterialshader_p.h>
 #include <private/qsgtexturematerial_p.h>
 #include <private/qsgdefaultrendercontext_p.h>
+#include <QElapsedTimer>
 
 class QNetworkReply;
 
@@ -276,6 +277,7 @@ protected:
     void initialize() override;
 
     int m_invert_id;
+    int m_luminance_id;
 };
 
 
@@ -388,6 +390,12 @@ private:
 //    QSGTextureMaterial m_material;
 };
 
+struct FlickerlessImageTile
+{
+    QRect rect; // in raster pixels
+    QQuickPixmap pix;
+};
+
 class QQuickFlickerlessImagePrivate: public QQuickImagePrivate
 {
 public:
@@ -395,10 +403,21 @@ public:
     {
         pixLoading = &back;
     }
-    ~QQuickFlickerlessImagePrivate() {}
+    ~QQuickFlickerlessImagePrivate()
+    {
+        qDeleteAll(tiles);
+    }
 
     QQuickPixmap back;
-
+    // Progressive mode: low resolution placeholder, shown until back is ready
+    QQuickPixmap preview;
+
+    // Tile mode: tiles of the high resolution raster, drawn on top of the
+    // (lower resolution) pix. Keyed by (row << 32 | column).
+    QHash<quint64, FlickerlessImageTile *> tiles;
+    QUrl tileUrl;
+    QSize tileGrid; // size of the raster the tiles are cut from
+    int tileGridSize = 0;
 };
 
 class QQuickFlickerlessImage : public QQuickImage
@@ -406,11 +425,16 @@ class QQuickFlickerlessImage : public QQuickImage
     Q_OBJECT
 
     Q_PROPERTY(bool invert READ invert WRITE setInvert NOTIFY invertChanged)
+    Q_PROPERTY(bool progressive READ progressive WRITE setProgressive NOTIFY progressiveChanged)
+    Q_PROPERTY(bool reloadOffscreen READ reloadOffscreen WRITE setReloadOffscreen NOTIFY reloadOffscreenChanged)
+    Q_PROPERTY(int tileSize READ tileSize WRITE setTileSize NOTIFY tileSizeChanged)
+    Q_PROPERTY(QSize tileRasterSize READ tileRasterSize WRITE setTileRasterSize NOTIFY tileRasterSizeChanged)
+    Q_PROPERTY(QRectF viewport READ viewport WRITE setViewport NOTIFY viewportChanged)
 public:
     QQuickFlickerlessImage(QQuickItem *parent=nullptr) : QQuickImage(*(new QQuickFlickerlessImagePrivate), parent)
     {
     }
-    ~QQuickFlickerlessImage() {}
+    ~QQuickFlickerlessImage();
 
     QSGNode *updatePaintNode(QSGNode *, UpdatePaintNodeData *) override;
 
@@ -427,9 +451,135 @@ public:
         emit invertChanged();
     }
 
+    // Progressive mode. While a new source loads, a low resolution version
+    // of it is requested as well, and shown in place of a blank or unrelated
+    // image until the full resolution one arrives.
+    bool progressive() const
+    {
+        return m_progressive;
+    }
+    void setProgressive(bool progressive)
+    {
+        if (progressive == m_progressive)
+            return;
+        m_progressive = progressive;
+        emit progressiveChanged();
+    }
+
+    // When false, reloads (source or sourceSize changes once an image is
+    // shown) are postponed while the item lies outside viewport, and the
+    // current image is stretched until then.
+    bool reloadOffscreen() const
+    {
+        return m_reloadOffscreen;
+    }
+    void setReloadOffscreen(bool reload)
+    {
+        if (reload == m_reloadOffscreen)
+            return;
+        m_reloadOffscreen = reload;
+        if (m_reloadOffscreen && m_reloadPending)
+            load();
+        emit reloadOffscreenChanged();
+    }
+
+    // Tile mode. When tileSize > 0 and tileRasterSize is larger than sourceSize,
+    // the parts of the item intersecting the viewport are additionally
+    // requested as tiles of a raster of tileRasterSize, and drawn over the
+    // base image. tileRasterSize follows the same convention of sourceSize.
+    int tileSize() const
+    {
+        return m_tileSize;
+    }
+    void setTileSize(int tileSize)
+    {
+        if (tileSize == m_tileSize)
+            return;
+        m_tileSize = tileSize;
+        updateTiles();
+        emit tileSizeChanged();
+    }
+
+    QSize tileRasterSize() const
+    {
+        return m_tileRasterSize;
+    }
+    void setTileRasterSize(const QSize &size)
+    {
+        if (size == m_tileRasterSize)
+            return;
+        m_tileRasterSize = size;
+        updateTiles();
+        emit tileRasterSizeChanged();
+    }
+
+    // How much of its images an item holds, see ImageMemoryGovernor
+    enum MemoryLevel {
+        Full = 0,
+        Reduced, // low resolution placeholder, in progressive mode, else nothing
+        Released
+    };
+    MemoryLevel memoryLevel() const
+    {
+        return m_memoryLevel;
+    }
+    // Back to Full once on screen again
+    void reduceMemory(MemoryLevel level);
+    bool isOnScreen() const;
+    // From the item to its viewport, in item coordinates. 0 when on screen
+    qreal viewportDistance() const;
+
+    // In item coordinates
+    QRectF viewport() const
+    {
+        return m_viewport;
+    }
+    void setViewport(const QRectF &viewport)
+    {
+        if (viewport == m_viewport)
+            return;
+        m_viewport = viewport;
+        if ((m_reloadPending || m_memoryLevel != Full) && isOnScreen())
+            load(); // also updates the tiles
+        else
+            updateTiles();
+        emit viewportChanged();
+    }
+
     QSGCoolTextureMaterial::GLImageNodePlusUniforms m_uniforms;
+    bool m_progressive = false;
+    bool m_reloadOffscreen = true;
+    bool m_reloadPending = false;
+    bool m_firstFramePending = false;
+    MemoryLevel m_memoryLevel = Full;
+    QElapsedTimer m_loadTimer;
+    int m_tileSize = 0;
+    QSize m_tileRasterSize;
+    QRectF m_viewport;
+
 Q_SIGNALS:
     void invertChanged();
+    void progressiveChanged();
+    void reloadOffscreenChanged();
+    void tileSizeChanged();
+    void tileRasterSizeChanged();
+    void viewportChanged();
+
+protected:
+    void load() override;
+    void componentComplete() override;
+    void geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry) override;
+    void loadPreview();
+    void pixmapChange() override;
+    void reportMemory();
+    void updateTiles();
+    void clearTiles();
+    void updateTileNodes(QSGNode *parentNode);
+
+private Q_SLOTS:
+    void previewRequestFinished();
+    void reducedRequestFinished();
+    void tileRequestFinished();
 
 private:
     Q_DISABLE_COPY(QQuickFlickerlessImage)
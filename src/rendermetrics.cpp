@@ -0,0 +1,122 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "rendermetrics.h"
+#include <QMutexLocker>
+#include <QVariantList>
+
+namespace {
+const char *phaseNames[RenderMetrics::PhaseCount] = {
+    "queueWait", "render", "crop", "textureFactory", "firstFrame"
+};
+const char *counterNames[RenderMetrics::CounterCount] = {
+    "requests", "memoryCacheHits", "diskCacheHits", "renders", "cancelled", "prefetches"
+};
+
+int bucketOf(qint64 nsecs)
+{
+    qint64 ms = nsecs / 1000000;
+    int bucket = 0;
+    while (ms > 0 && bucket < RenderMetrics::BucketCount - 1) {
+        ms >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+// Upper bound of the bucket the p-th quantile falls in
+double quantileMs(const quint64 *buckets, quint64 count, qint64 maxNsecs, double p)
+{
+    if (!count)
+        return 0;
+    const quint64 target = quint64(count * p);
+    quint64 cumulative = 0;
+    for (int i = 0; i < RenderMetrics::BucketCount - 1; ++i) {
+        cumulative += buckets[i];
+        if (cumulative > target)
+            return qMin<double>(1 << i, maxNsecs / 1e6);
+    }
+    return maxNsecs / 1e6;
+}
+} // namespace
+
+RenderMetrics &RenderMetrics::instance()
+{
+    static RenderMetrics metrics;
+    return metrics;
+}
+
+void RenderMetrics::record(Phase phase, qint64 nsecs)
+{
+    QMutexLocker locker(&m_mutex);
+    PhaseData &d = m_phases[phase];
+    ++d.count;
+    d.totalNsecs += nsecs;
+    d.maxNsecs = qMax(d.maxNsecs, nsecs);
+    ++d.buckets[bucketOf(nsecs)];
+    m_version.fetchAndAddRelaxed(1);
+}
+
+void RenderMetrics::count(Counter counter, int n)
+{
+    QMutexLocker locker(&m_mutex);
+    m_counters[counter] += n;
+    m_version.fetchAndAddRelaxed(1);
+}
+
+void RenderMetrics::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    for (PhaseData &d: m_phases)
+        d = PhaseData();
+    for (quint64 &c: m_counters)
+        c = 0;
+    m_version.fetchAndAddRelaxed(1);
+}
+
+quint64 RenderMetrics::version() const
+{
+    return m_version.loadRelaxed();
+}
+
+QVariantMap RenderMetrics::toVariantMap() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVariantMap res;
+    for (int i = 0; i < PhaseCount; ++i) {
+        const PhaseData &d = m_phases[i];
+        QVariantList histogram;
+        for (quint64 b: d.buckets)
+            histogram.append(b);
+        QVariantMap phase;
+        phase[QStringLiteral("count")] = d.count;
+        phase[QStringLiteral("mean_ms")] = (d.count) ? d.totalNsecs / 1e6 / d.count : 0.0;
+        phase[QStringLiteral("max_ms")] = d.maxNsecs / 1e6;
+        phase[QStringLiteral("p50_ms")] = quantileMs(d.buckets, d.count, d.maxNsecs, 0.5);
+        phase[QStringLiteral("p95_ms")] = quantileMs(d.buckets, d.count, d.maxNsecs, 0.95);
+        phase[QStringLiteral("histogram")] = histogram;
+        res[QLatin1String(phaseNames[i])] = phase;
+    }
+
+    QVariantMap counters;
+    for (int i = 0; i < CounterCount; ++i)
+        counters[QLatin1String(counterNames[i])] = m_counters[i];
+    res[QStringLiteral("counters")] = counters;
+
+    QVariantList bounds;
+    for (int i = 0; i < BucketCount - 1; ++i)
+        bounds.append(1 << i);
+    res[QStringLiteral("buckets_ms")] = bounds;
+    return res;
+}
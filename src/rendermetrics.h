@@ -0,0 +1,79 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef RENDERMETRICS_H
+#define RENDERMETRICS_H
+
+#include <QMutex>
+#include <QVariantMap>
+#include <QAtomicInteger>
+
+// Process wide counters and latency histograms of the page requests, per
+// phase. Recording is thread safe, and cheap enough to stay always on.
+class RenderMetrics
+{
+public:
+    enum Phase {
+        QueueWait = 0,  // request issued -> worker picks it up
+        Render,         // pdfium, whole page renders
+        Crop,           // pdfium, renders clipped to the cropped area or to a tile
+        TextureFactory, // creation of the texture factory of a finished request
+        FirstFrame,     // source (re)load -> first frame showing the full resolution image
+        PhaseCount
+    };
+
+    enum Counter {
+        Requests = 0,
+        MemoryCacheHits,
+        DiskCacheHits,
+        Renders,
+        Cancelled,
+        Prefetches,
+        CounterCount
+    };
+
+    static RenderMetrics &instance();
+
+    void record(Phase phase, qint64 nsecs);
+    void count(Counter counter, int n = 1);
+    void reset();
+
+    // Incremented by every record() and count()
+    quint64 version() const;
+
+    // { "<phase>": { count, mean_ms, max_ms, p50_ms, p95_ms, histogram },
+    //   "counters": { "<counter>": n },
+    //   "buckets_ms": [ upper bounds of the histogram buckets ] }
+    QVariantMap toVariantMap() const;
+
+    static const int BucketCount = 12; // <1ms, <2ms, ..., <1024ms, above
+
+private:
+    RenderMetrics() = default;
+
+    struct PhaseData
+    {
+        quint64 count = 0;
+        qint64 totalNsecs = 0;
+        qint64 maxNsecs = 0;
+        quint64 buckets[BucketCount] = {};
+    };
+
+    mutable QMutex m_mutex;
+    PhaseData m_phases[PhaseCount];
+    quint64 m_counters[CounterCount] = {};
+    QAtomicInteger<quint64> m_version;
+};
+
+#endif // RENDERMETRICS_H
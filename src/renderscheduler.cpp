@@ -0,0 +1,208 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "renderscheduler.h"
+#include <QMutexLocker>
+
+class RenderWorker : public QThread
+{
+public:
+    RenderWorker(RenderScheduler &scheduler) : m_scheduler(scheduler) {}
+
+protected:
+    void run() override
+    {
+        m_scheduler.workerLoop();
+    }
+
+    RenderScheduler &m_scheduler;
+};
+
+RenderScheduler::RenderScheduler(int threadCount)
+{
+    QMutexLocker locker(&m_mutex);
+    m_threadCount = qMax(1, threadCount);
+    startWorkers();
+}
+
+RenderScheduler::~RenderScheduler()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_quit = true;
+        for (const Job &j: qAsConst(m_queue)) {
+            if (j.runnable->autoDelete())
+                delete j.runnable;
+        }
+        m_queue.clear();
+        m_wakeUp.wakeAll();
+        m_idle.wakeAll();
+    }
+    for (QThread *w: qAsConst(m_workers)) {
+        w->wait();
+        delete w;
+    }
+}
+
+void RenderScheduler::start(QRunnable *runnable, int documentId, int page, Priority hint)
+{
+    QMutexLocker locker(&m_mutex);
+    m_queue.append({runnable, documentId, page, hint});
+    m_wakeUp.wakeOne();
+}
+
+bool RenderScheduler::tryTake(QRunnable *runnable)
+{
+    QMutexLocker locker(&m_mutex);
+    for (int i = 0; i < m_queue.size(); ++i) {
+        if (m_queue.at(i).runnable == runnable) {
+            m_queue.remove(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void RenderScheduler::waitForDone()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_quit && (m_running || !m_queue.isEmpty()))
+        m_idle.wait(&m_mutex);
+}
+
+void RenderScheduler::setViewport(int documentId, int firstPage, int lastPage)
+{
+    QMutexLocker locker(&m_mutex);
+    m_viewports.insert(documentId, qMakePair(qMin(firstPage, lastPage), qMax(firstPage, lastPage)));
+}
+
+void RenderScheduler::removeDocument(int documentId)
+{
+    QMutexLocker locker(&m_mutex);
+    m_viewports.remove(documentId);
+}
+
+int RenderScheduler::adjacentPages() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_adjacentPages;
+}
+
+void RenderScheduler::setAdjacentPages(int pages)
+{
+    QMutexLocker locker(&m_mutex);
+    m_adjacentPages = qMax(0, pages);
+}
+
+int RenderScheduler::threadCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_threadCount;
+}
+
+void RenderScheduler::setThreadCount(int threadCount)
+{
+    QMutexLocker locker(&m_mutex);
+    m_threadCount = qMax(1, threadCount);
+    m_wakeUp.wakeAll(); // the surplus ones exit
+    startWorkers();
+}
+
+void RenderScheduler::startWorkers()
+{
+    for (int i = m_workers.size() - 1; i >= 0; --i) {
+        QThread *w = m_workers.at(i);
+        if (w->isFinished()) {
+            delete w;
+            m_workers.remove(i);
+        }
+    }
+    while (m_activeWorkers < m_threadCount) {
+        RenderWorker *w = new RenderWorker(*this);
+        w->setObjectName(QStringLiteral("RenderWorker") + QString::number(m_spawnedWorkers++));
+        m_workers.append(w);
+        ++m_activeWorkers;
+        w->start();
+    }
+}
+
+RenderScheduler::Priority RenderScheduler::priorityOf(const Job &job, int &distance) const
+{
+    distance = 0;
+    auto it = m_viewports.constFind(job.documentId);
+    if (it == m_viewports.constEnd() || job.page < 0)
+        return job.hint;
+
+    const int first = it.value().first;
+    const int last = it.value().second;
+    if (job.page < first)
+        distance = first - job.page;
+    else if (job.page > last)
+        distance = job.page - last;
+
+    if (job.hint == Speculative)
+        return Speculative;
+    if (distance == 0)
+        return (job.hint == Preview) ? Preview : Visible;
+    if (distance > m_adjacentPages)
+        return Speculative;
+    return Adjacent;
+}
+
+void RenderScheduler::workerLoop()
+{
+    forever {
+        QRunnable *runnable = nullptr;
+        {
+            QMutexLocker locker(&m_mutex);
+            while (!m_quit && m_activeWorkers <= m_threadCount && m_queue.isEmpty())
+                m_wakeUp.wait(&m_mutex);
+            if (m_quit)
+                return;
+            if (m_activeWorkers > m_threadCount) {
+                --m_activeWorkers;
+                return;
+            }
+
+            int best = -1;
+            Priority bestPriority = Speculative;
+            int bestDistance = 0;
+            for (int i = 0; i < m_queue.size(); ++i) {
+                int distance;
+                const Priority p = priorityOf(m_queue.at(i), distance);
+                // ties are broken by distance from the viewport, then FIFO:
+                // m_queue is kept in submission order and the first wins
+                if (best < 0
+                        || p < bestPriority
+                        || (p == bestPriority && distance < bestDistance)) {
+                    best = i;
+                    bestPriority = p;
+                    bestDistance = distance;
+                }
+            }
+            runnable = m_queue.at(best).runnable;
+            m_queue.remove(best);
+            ++m_running;
+        }
+
+        const bool autoDelete = runnable->autoDelete();
+        runnable->run();
+        if (autoDelete)
+            delete runnable;
+
+        QMutexLocker locker(&m_mutex);
+        if (--m_running == 0 && m_queue.isEmpty())
+            m_idle.wakeAll();
+    }
+}
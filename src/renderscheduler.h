@@ -0,0 +1,98 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef RENDERSCHEDULER_H
+#define RENDERSCHEDULER_H
+
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QRunnable>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+// Replaces a FIFO QThreadPool for page renders.
+// Every queued job is tied to a document page, and the next job to run is
+// always chosen against the current viewport of its document: visible pages
+// first (low resolution previews of them before anything else), then pages
+// adjacent to the visible ones, then everything else.
+// Since priorities are evaluated at dequeue time, moving the viewport
+// re-prioritizes all queued work.
+// There should be as many workers as replicas a document may have (see
+// DocumentReplicaPool): surplus workers would only dequeue jobs to block on
+// the replica, which then run in no particular order, prioritized against
+// a viewport that may have moved meanwhile.
+class RenderScheduler
+{
+public:
+    enum Priority {
+        Preview = 0, // quick low resolution renders of visible pages
+        Visible,
+        Adjacent,
+        Speculative
+    };
+
+    RenderScheduler(int threadCount = 1);
+    ~RenderScheduler();
+
+    // hint is used for pages outside the viewport, and when the viewport of
+    // the document is not known. Speculative jobs are never raised, on
+    // screen or not: the viewport only orders them among themselves.
+    void start(QRunnable *runnable, int documentId, int page, Priority hint = Adjacent);
+    bool tryTake(QRunnable *runnable);
+    // Blocks until all the queued jobs have run
+    void waitForDone();
+
+    void setViewport(int documentId, int firstPage, int lastPage);
+    void removeDocument(int documentId);
+
+    // How many pages before/after the visible ones are considered Adjacent
+    int adjacentPages() const;
+    void setAdjacentPages(int pages);
+
+    int threadCount() const;
+    // Surplus workers exit once done with their current job
+    void setThreadCount(int threadCount);
+
+private:
+    struct Job
+    {
+        QRunnable *runnable;
+        int documentId;
+        int page;
+        Priority hint;
+    };
+
+    Priority priorityOf(const Job &job, int &distance) const;
+    void workerLoop();
+    void startWorkers(); // m_mutex held
+
+    friend class RenderWorker;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_wakeUp;
+    QWaitCondition m_idle; // nothing queued nor running
+    QVector<Job> m_queue;
+    QHash<int, QPair<int, int>> m_viewports;
+    QVector<QThread *> m_workers; // including exited ones, until reaped
+    int m_threadCount = 0;
+    int m_activeWorkers = 0;
+    int m_spawnedWorkers = 0;
+    int m_running = 0;
+    int m_adjacentPages = 2;
+    bool m_quit = false;
+};
+
+#endif // RENDERSCHEDULER_H
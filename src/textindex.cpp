@@ -0,0 +1,423 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "textindex.h"
+#include "pdfimageprovider.h"
+#include "tracelog.h"
+#include <QAtomicInt>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QMutexLocker>
+#include <QPdfDocument>
+#include <QPdfSelection>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QSemaphore>
+#include <QStandardPaths>
+#include <algorithm>
+
+namespace {
+const quint32 kMagic = 0x51444649; // "QDFI"
+const quint32 kVersion = 1;
+const qint64 kHeaderSize = 5 * sizeof(quint32);
+const qint64 kMinTermSize = 2 * sizeof(quint32); // empty string length, offset
+const qint64 kPostingSize = 4 * sizeof(qint32);
+
+struct Posting
+{
+    qint32 page;
+    qint32 position; // word number in the page, for matching phrases
+    qint32 start;
+    qint32 length;
+};
+
+inline quint64 wordKey(qint32 page, qint32 position)
+{
+    return (quint64(quint32(page)) << 32) | quint32(position);
+}
+
+// Calls f(start, length) for each run of letters and digits
+template <typename F>
+void forEachWord(const QString &text, F f)
+{
+    const int n = text.size();
+    int i = 0;
+    while (i < n) {
+        while (i < n && !text.at(i).isLetterOrNumber())
+            ++i;
+        const int start = i;
+        while (i < n && text.at(i).isLetterOrNumber())
+            ++i;
+        if (i > start)
+            f(start, i - start);
+    }
+}
+} // namespace
+
+// Immutable once built. Terms are sorted, so that prefixes are ranges, and
+// the postings of terms[i] are postings[offsets[i]..offsets[i + 1]), sorted
+// by page and position.
+struct TextIndex::Index
+{
+    QVector<QString> terms;
+    QVector<quint32> offsets;
+    QVector<Posting> postings;
+
+    // Indexes in terms of term, or of all the terms starting with it
+    QPair<int, int> range(const QString &term, bool prefix) const
+    {
+        const auto first = std::lower_bound(terms.cbegin(), terms.cend(), term);
+        auto last = first;
+        if (prefix) {
+            while (last != terms.cend() && last->startsWith(term))
+                ++last;
+        } else if (last != terms.cend() && *last == term) {
+            ++last;
+        }
+        return qMakePair(int(first - terms.cbegin()), int(last - terms.cbegin()));
+    }
+};
+
+struct TextIndex::Document
+{
+    QString filePath;
+    int pageCount = 0;
+    QSharedPointer<const TextIndex::Index> index; // null until built
+    QAtomicInt cancelled;
+};
+
+// Extracts the text of one page on the RenderScheduler, for TextIndexJob to
+// wait on
+class TextExtractionTask : public QRunnable
+{
+public:
+    TextExtractionTask(PdfManager &manager, int documentId, int page)
+        : m_manager(manager), m_documentId(documentId), m_page(page)
+    {
+        setAutoDelete(false); // owned by the TextIndexJob
+    }
+
+    void run() override
+    {
+        TraceScope trace("textindex", "TextExtractionTask::run", QString::number(m_page));
+        const QSharedPointer<const PdfManager::DocumentState> state
+                = m_manager.documentState(m_documentId);
+        if (state) {
+            DocumentReplicaPool::Lease lease(state->replicas);
+            if (lease.document()) {
+                m_text = lease.document()->getAllText(m_page).text();
+                m_extracted = true;
+            }
+        }
+        m_done.release();
+    }
+
+    PdfManager &m_manager;
+    int m_documentId;
+    int m_page;
+    QString m_text;
+    bool m_extracted = false; // false when the document got closed
+    QSemaphore m_done;
+};
+
+// Loads the persisted index of a document, or extracts the text of all pages
+// to build it, and persists it.
+// Extraction goes through the RenderScheduler at Speculative priority, one
+// page at a time like ThumbnailJob's renders, so that it takes the replica
+// and the pdfium lock only when no page render is queued.
+class TextIndexJob : public QRunnable
+{
+public:
+    TextIndexJob(TextIndex &store, PdfManager &manager, int documentId,
+                 const QSharedPointer<TextIndex::Document> &document)
+        : m_store(store), m_manager(manager), m_documentId(documentId), m_document(document) {}
+
+    void run() override
+    {
+        TraceScope trace("textindex", "TextIndexJob::run", QString::number(m_documentId));
+        QSharedPointer<const TextIndex::Index> index = load();
+        if (!index) {
+            index = build();
+            if (!index)
+                return; // cancelled
+            save(*index);
+        }
+        {
+            QMutexLocker locker(&m_store.m_mutex);
+            m_document->index = index;
+        }
+        emit m_store.indexReady(m_documentId);
+    }
+
+private:
+    QSharedPointer<const TextIndex::Index> build()
+    {
+        TextIndex::Document &d = *m_document;
+        QHash<QString, QVector<Posting>> postings;
+        for (int page = 0; page < d.pageCount; ++page) {
+            QString text;
+            if (!extract(page, text))
+                return QSharedPointer<const TextIndex::Index>(); // cancelled or closed
+            int position = 0;
+            forEachWord(text, [&](int start, int length) {
+                postings[text.mid(start, length).toCaseFolded()]
+                        .append({ page, position++, start, length });
+            });
+        }
+
+        QSharedPointer<TextIndex::Index> index(new TextIndex::Index);
+        index->terms = postings.keys().toVector();
+        std::sort(index->terms.begin(), index->terms.end());
+        index->offsets.reserve(index->terms.size() + 1);
+        for (const QString &term: qAsConst(index->terms)) {
+            index->offsets.append(quint32(index->postings.size()));
+            index->postings.append(postings.value(term)); // appended in page order
+        }
+        index->offsets.append(quint32(index->postings.size()));
+        return index;
+    }
+
+    bool extract(int page, QString &text)
+    {
+        RenderScheduler &scheduler = PdfImageProvider::instance().m_scheduler;
+        TextExtractionTask task(m_manager, m_documentId, page);
+        // No page: extraction does not become Visible with the page it reads
+        scheduler.start(&task, m_documentId, -1, RenderScheduler::Speculative);
+        while (!task.m_done.tryAcquire(1, 100)) {
+            if (m_document->cancelled.loadAcquire() && scheduler.tryTake(&task))
+                return false;
+        }
+        text = task.m_text;
+        return task.m_extracted && !m_document->cancelled.loadAcquire();
+    }
+
+    // Null if missing or invalid, invalid files are discarded
+    QSharedPointer<const TextIndex::Index> load()
+    {
+        const TextIndex::Document &d = *m_document;
+        QFile f(d.filePath);
+        if (!f.open(QIODevice::ReadOnly))
+            return QSharedPointer<const TextIndex::Index>();
+        QSharedPointer<const TextIndex::Index> index = read(f);
+        f.close();
+        if (!index) {
+            qWarning() << "TextIndex: discarding invalid" << d.filePath;
+            QFile::remove(d.filePath);
+        }
+        return index;
+    }
+
+    QSharedPointer<const TextIndex::Index> read(QFile &f)
+    {
+        const TextIndex::Document &d = *m_document;
+        const QSharedPointer<const TextIndex::Index> invalid;
+        QDataStream s(&f);
+        quint32 magic, version, pageCount, termCount, postingCount;
+        s >> magic >> version >> pageCount >> termCount >> postingCount;
+        if (magic != kMagic || version != kVersion || pageCount != quint32(d.pageCount)
+                || s.status() != QDataStream::Ok)
+            return invalid;
+        // Before reserving anything: the counts have to fit the file
+        const qint64 minimumSize = kHeaderSize + qint64(termCount) * kMinTermSize
+                + qint64(postingCount) * kPostingSize;
+        if (minimumSize > f.size())
+            return invalid;
+
+        QSharedPointer<TextIndex::Index> index(new TextIndex::Index);
+        index->terms.reserve(int(termCount));
+        index->offsets.reserve(int(termCount) + 1);
+        for (quint32 i = 0; i < termCount && s.status() == QDataStream::Ok; ++i) {
+            QString term;
+            quint32 offset;
+            s >> term >> offset;
+            // Sorted terms, postings in order
+            if (term.isEmpty() || (i && !(index->terms.last() < term))
+                    || offset > postingCount || (i ? offset < index->offsets.last() : offset != 0))
+                return invalid;
+            index->terms.append(term);
+            index->offsets.append(offset);
+        }
+        index->offsets.append(postingCount);
+        index->postings.reserve(int(postingCount));
+        for (quint32 i = 0; i < postingCount && s.status() == QDataStream::Ok; ++i) {
+            Posting p;
+            s >> p.page >> p.position >> p.start >> p.length;
+            if (p.page < 0 || p.page >= d.pageCount || p.position < 0 || p.start < 0 || p.length <= 0)
+                return invalid;
+            index->postings.append(p);
+        }
+        if (s.status() != QDataStream::Ok || !s.atEnd())
+            return invalid;
+        return index;
+    }
+
+    void save(const TextIndex::Index &index)
+    {
+        const TextIndex::Document &d = *m_document;
+        if (!QDir().mkpath(QFileInfo(d.filePath).absolutePath()))
+            return;
+        QSaveFile f(d.filePath);
+        if (!f.open(QIODevice::WriteOnly))
+            return;
+        QDataStream s(&f);
+        s << kMagic << kVersion << quint32(d.pageCount) << quint32(index.terms.size())
+          << quint32(index.postings.size());
+        for (int i = 0; i < index.terms.size(); ++i)
+            s << index.terms.at(i) << index.offsets.at(i);
+        for (const Posting &p: index.postings)
+            s << p.page << p.position << p.start << p.length;
+        f.commit();
+    }
+
+    TextIndex &m_store;
+    PdfManager &m_manager;
+    int m_documentId;
+    QSharedPointer<TextIndex::Document> m_document;
+};
+
+TextIndex::TextIndex(QObject *parent) : QObject(parent)
+{
+    m_directory = QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation)
+            + QStringLiteral("/textindex");
+    m_pool.setMaxThreadCount(1);
+}
+
+TextIndex::~TextIndex()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        for (const auto &d: qAsConst(m_documents))
+            d->cancelled.storeRelease(1);
+    }
+    m_pool.waitForDone();
+}
+
+void TextIndex::openDocument(int documentId, const QString &documentKey, int pageCount,
+                             PdfManager &manager)
+{
+    QSharedPointer<Document> d(new Document);
+    d->pageCount = pageCount;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_documents.contains(documentId))
+            return;
+        d->filePath = m_directory + QLatin1Char('/')
+                + QString::fromLatin1(QCryptographicHash::hash(documentKey.toUtf8(),
+                                                               QCryptographicHash::Sha1).toHex())
+                + QStringLiteral(".index");
+        m_documents.insert(documentId, d);
+    }
+    m_pool.start(new TextIndexJob(*this, manager, documentId, d));
+}
+
+void TextIndex::closeDocument(int documentId)
+{
+    QMutexLocker locker(&m_mutex);
+    const QSharedPointer<Document> d = m_documents.take(documentId);
+    if (d)
+        d->cancelled.storeRelease(1);
+}
+
+void TextIndex::waitForDone()
+{
+    m_pool.waitForDone();
+}
+
+bool TextIndex::isIndexed(int documentId) const
+{
+    QMutexLocker locker(&m_mutex);
+    const QSharedPointer<Document> d = m_documents.value(documentId);
+    return d && d->index;
+}
+
+QVector<TextIndex::Hit> TextIndex::search(int documentId, const QString &query, int maxHits) const
+{
+    QSharedPointer<const Index> index;
+    {
+        QMutexLocker locker(&m_mutex);
+        const QSharedPointer<Document> d = m_documents.value(documentId);
+        if (d)
+            index = d->index;
+    }
+    QVector<Hit> hits;
+    if (!index || maxHits <= 0)
+        return hits;
+    QVector<QString> words;
+    forEachWord(query, [&](int start, int length) {
+        words.append(query.mid(start, length).toCaseFolded());
+    });
+    if (words.isEmpty())
+        return hits;
+
+    // Words after the first one, by page and position
+    QVector<QHash<quint64, const Posting *>> following(words.size() - 1);
+    for (int w = 1; w < words.size(); ++w) {
+        const QPair<int, int> terms = index->range(words.at(w), w == words.size() - 1);
+        for (int t = terms.first; t < terms.second; ++t) {
+            for (quint32 i = index->offsets.at(t); i < index->offsets.at(t + 1); ++i) {
+                const Posting &p = index->postings.at(int(i));
+                following[w - 1].insert(wordKey(p.page, p.position), &p);
+            }
+        }
+        if (following.at(w - 1).isEmpty())
+            return hits;
+    }
+
+    // Prefixes match several terms, each with its own page ordered postings:
+    // merged in page order, so that collecting stops after maxHits hits
+    typedef QPair<quint32, quint32> Cursor; // next posting, end
+    const auto later = [&index](const Cursor &a, const Cursor &b) {
+        const Posting &pa = index->postings.at(int(a.first));
+        const Posting &pb = index->postings.at(int(b.first));
+        return (pa.page != pb.page) ? pa.page > pb.page : pa.position > pb.position;
+    };
+    QVector<Cursor> heap;
+    const QPair<int, int> terms = index->range(words.first(), words.size() == 1);
+    for (int t = terms.first; t < terms.second; ++t) {
+        if (index->offsets.at(t) < index->offsets.at(t + 1))
+            heap.append(qMakePair(index->offsets.at(t), index->offsets.at(t + 1)));
+    }
+    std::make_heap(heap.begin(), heap.end(), later);
+    while (!heap.isEmpty() && hits.size() < maxHits) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        Cursor &c = heap.last();
+        const Posting &first = index->postings.at(int(c.first));
+        if (++c.first < c.second)
+            std::push_heap(heap.begin(), heap.end(), later);
+        else
+            heap.removeLast();
+
+        const Posting *last = &first;
+        for (int w = 0; w < following.size() && last; ++w)
+            last = following.at(w).value(wordKey(first.page, first.position + w + 1), nullptr);
+        if (last)
+            hits.append({ first.page, first.start, last->start + last->length - first.start });
+    }
+    return hits;
+}
+
+QString TextIndex::directory() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_directory;
+}
+
+void TextIndex::setDirectory(const QString &path)
+{
+    QMutexLocker locker(&m_mutex);
+    m_directory = path;
+}
@@ -0,0 +1,83 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef TEXTINDEX_H
+#define TEXTINDEX_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QMutex>
+#include <QHash>
+#include <QVector>
+#include <QString>
+#include <QSharedPointer>
+
+class PdfManager;
+
+// Inverted index of the words of every page of the open documents, for
+// in-document search.
+// The text of the pages is extracted once a document is ready, one page at a
+// time at Speculative priority in the RenderScheduler like ThumbnailStore
+// thumbnails, and the index is persisted per document under the same
+// fileName + bytesCount key, so that it is built only once. Searches are answered from the index alone.
+// Postings locate words by character range within the text of their page,
+// the range QPdfDocument::getSelectionAtIndex turns into rectangles when a
+// hit gets highlighted.
+class TextIndex : public QObject
+{
+    Q_OBJECT
+public:
+    struct Hit
+    {
+        int page;
+        int start; // in the text of the page
+        int length;
+    };
+
+    TextIndex(QObject *parent = nullptr);
+    ~TextIndex() override;
+
+    // GUI thread
+    void openDocument(int documentId, const QString &documentKey, int pageCount,
+                      PdfManager &manager);
+    void closeDocument(int documentId);
+    // Blocks until the jobs of the closed documents have stopped
+    void waitForDone();
+
+    // Thread safe
+    bool isIndexed(int documentId) const;
+    // Occurrences of the words of query, in this order, in page order.
+    // Case insensitive; the last word also matches as a prefix, so that
+    // results can follow typing.
+    QVector<Hit> search(int documentId, const QString &query, int maxHits) const;
+
+    QString directory() const;
+    void setDirectory(const QString &path);
+
+signals:
+    // Emitted from the indexing thread
+    void indexReady(int documentId);
+
+private:
+    struct Index;
+    struct Document;
+    friend class TextIndexJob;
+
+    mutable QMutex m_mutex;
+    QHash<int, QSharedPointer<Document>> m_documents;
+    QString m_directory;
+    QThreadPool m_pool;
+};
+
+#endif // TEXTINDEX_H
@@ -0,0 +1,318 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "thumbnailstore.h"
+#include "pdfimageprovider.h"
+#include "tracelog.h"
+#include <QAtomicInt>
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QImageWriter>
+#include <QMutexLocker>
+#include <QPainter>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QSemaphore>
+#include <QStandardPaths>
+
+namespace {
+const quint32 kMagic = 0x51444654; // "QDFT"
+const quint32 kVersion = 2; // 1 stretched tall pages
+// Taller pages are letterboxed, like in PageOverview
+const qreal kMaxAspect = 2.0;
+
+QByteArray encode(const QImage &image)
+{
+    static const QByteArray format = QImageWriter::supportedImageFormats().contains("jpg")
+            ? QByteArrayLiteral("jpg") : QByteArrayLiteral("png");
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QImageWriter writer(&buffer, format);
+    writer.setQuality(80);
+    writer.write(image);
+    return data;
+}
+} // namespace
+
+struct ThumbnailStore::Document
+{
+    QString filePath;
+    QVector<QSizeF> pageSizes;
+    QVector<QByteArray> thumbnails; // encoded, empty until generated
+    QAtomicInt cancelled;
+};
+
+// Renders one thumbnail on the RenderScheduler, for ThumbnailJob to wait on
+class ThumbnailRenderTask : public QRunnable
+{
+public:
+    ThumbnailRenderTask(PdfManager &manager, int documentId, int page, QSize size)
+        : m_manager(manager), m_documentId(documentId), m_page(page), m_size(size)
+    {
+        setAutoDelete(false); // owned by the ThumbnailJob
+    }
+
+    void run() override
+    {
+        TraceScope trace("thumbnails", "ThumbnailRenderTask::run", QString::number(m_page));
+        m_image = m_manager.render(m_documentId, m_page, m_size);
+        m_done.release();
+    }
+
+    PdfManager &m_manager;
+    int m_documentId;
+    int m_page;
+    QSize m_size;
+    QImage m_image;
+    QSemaphore m_done;
+};
+
+// Loads the persisted thumbnails of a document, generates the missing ones and
+// persists them again.
+// Rendering goes through the RenderScheduler at Speculative priority, one
+// page at a time, so that it shares the replicas and the pdfium lock with
+// the page renders only when nothing more urgent is queued. Thread priorities
+// are not relied upon, they are ignored by the default Linux scheduler.
+class ThumbnailJob : public QRunnable
+{
+public:
+    ThumbnailJob(ThumbnailStore &store, PdfManager &manager, int documentId,
+                 const QSharedPointer<ThumbnailStore::Document> &document)
+        : m_store(store), m_manager(manager), m_documentId(documentId), m_document(document) {}
+
+    void run() override
+    {
+        TraceScope trace("thumbnails", "ThumbnailJob::run", QString::number(m_documentId));
+        ThumbnailStore::Document &d = *m_document;
+        const int pageCount = d.pageSizes.size();
+        const int loaded = load();
+        if (loaded == pageCount)
+            return;
+
+        int generated = 0;
+        for (int page = 0; page < pageCount && !d.cancelled.loadAcquire(); ++page) {
+            {
+                QMutexLocker locker(&m_store.m_mutex);
+                if (!d.thumbnails.at(page).isEmpty())
+                    continue;
+            }
+            const QSizeF &ps = d.pageSizes.at(page);
+            const qreal aspect = (ps.width() > 0) ? ps.height() / ps.width() : 1.0;
+            const QSize size(ThumbnailStore::Width,
+                             qMax(1, qRound(ThumbnailStore::Width * qMin(kMaxAspect, aspect))));
+            // Taller pages keep their aspect ratio, centered
+            const QSize pageSize = (aspect > kMaxAspect)
+                    ? QSize(qMax(1, qRound(size.height() / aspect)), size.height())
+                    : size;
+            const QImage rendered = render(page, pageSize);
+            if (rendered.isNull())
+                continue; // e.g. the document got closed
+            QImage thumbnail(size, QImage::Format_RGB32);
+            thumbnail.fill(Qt::white);
+            {
+                QPainter p(&thumbnail);
+                p.drawImage((size.width() - rendered.width()) / 2, 0, rendered);
+            }
+            const QByteArray data = encode(thumbnail);
+            {
+                QMutexLocker locker(&m_store.m_mutex);
+                d.thumbnails[page] = data;
+            }
+            ++generated;
+            emit m_store.thumbnailReady(m_documentId, page);
+        }
+        if (generated)
+            save(); // also when cancelled, what is done is done
+    }
+
+private:
+    QImage render(int page, QSize size)
+    {
+        RenderScheduler &scheduler = PdfImageProvider::instance().m_scheduler;
+        ThumbnailRenderTask task(m_manager, m_documentId, page, size);
+        // No page: thumbnails do not become Visible with the page they show
+        scheduler.start(&task, m_documentId, -1, RenderScheduler::Speculative);
+        while (!task.m_done.tryAcquire(1, 100)) {
+            if (m_document->cancelled.loadAcquire() && scheduler.tryTake(&task))
+                return QImage();
+        }
+        return task.m_image;
+    }
+
+    int load()
+    {
+        ThumbnailStore::Document &d = *m_document;
+        QFile f(d.filePath);
+        if (!f.open(QIODevice::ReadOnly))
+            return 0;
+        QDataStream s(&f);
+        quint32 magic, version, width, count;
+        s >> magic >> version >> width >> count;
+        if (magic != kMagic || version != kVersion || width != quint32(ThumbnailStore::Width)
+                || count != quint32(d.pageSizes.size()))
+            return 0;
+        QVector<QByteArray> thumbnails;
+        thumbnails.reserve(int(count));
+        for (quint32 i = 0; i < count; ++i) {
+            QByteArray data;
+            s >> data;
+            thumbnails.append(data);
+        }
+        if (s.status() != QDataStream::Ok)
+            return 0;
+        int loaded = 0;
+        {
+            QMutexLocker locker(&m_store.m_mutex);
+            d.thumbnails = thumbnails;
+        }
+        for (int i = 0; i < thumbnails.size(); ++i) {
+            if (!thumbnails.at(i).isEmpty()) {
+                ++loaded;
+                emit m_store.thumbnailReady(m_documentId, i);
+            }
+        }
+        return loaded;
+    }
+
+    void save()
+    {
+        ThumbnailStore::Document &d = *m_document;
+        if (!QDir().mkpath(QFileInfo(d.filePath).absolutePath()))
+            return;
+        QSaveFile f(d.filePath);
+        if (!f.open(QIODevice::WriteOnly))
+            return;
+        QDataStream s(&f);
+        s << kMagic << kVersion << quint32(ThumbnailStore::Width) << quint32(d.pageSizes.size());
+        {
+            QMutexLocker locker(&m_store.m_mutex);
+            for (const QByteArray &data: qAsConst(d.thumbnails))
+                s << data;
+        }
+        f.commit();
+    }
+
+    ThumbnailStore &m_store;
+    PdfManager &m_manager;
+    int m_documentId;
+    QSharedPointer<ThumbnailStore::Document> m_document;
+};
+
+ThumbnailStore::ThumbnailStore(QObject *parent) : QObject(parent)
+{
+    m_directory = QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation)
+            + QStringLiteral("/thumbnails");
+    m_pool.setMaxThreadCount(1);
+}
+
+ThumbnailStore::~ThumbnailStore()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        for (const auto &d: qAsConst(m_documents))
+            d->cancelled.storeRelease(1);
+    }
+    m_pool.waitForDone();
+}
+
+void ThumbnailStore::openDocument(int documentId, const QString &documentKey,
+                                  const QVector<QSizeF> &pageSizes, PdfManager &manager)
+{
+    QSharedPointer<Document> d(new Document);
+    d->pageSizes = pageSizes;
+    d->thumbnails.resize(pageSizes.size());
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_documents.contains(documentId))
+            return;
+        d->filePath = m_directory + QLatin1Char('/')
+                + QString::fromLatin1(QCryptographicHash::hash(documentKey.toUtf8(),
+                                                               QCryptographicHash::Sha1).toHex())
+                + QStringLiteral(".thumbs");
+        m_documents.insert(documentId, d);
+    }
+    m_pool.start(new ThumbnailJob(*this, manager, documentId, d));
+}
+
+void ThumbnailStore::closeDocument(int documentId)
+{
+    QMutexLocker locker(&m_mutex);
+    const QSharedPointer<Document> d = m_documents.take(documentId);
+    if (d)
+        d->cancelled.storeRelease(1);
+}
+
+void ThumbnailStore::waitForDone()
+{
+    m_pool.waitForDone();
+}
+
+QImage ThumbnailStore::thumbnail(int documentId, int page) const
+{
+    QByteArray data;
+    {
+        QMutexLocker locker(&m_mutex);
+        const QSharedPointer<Document> d = m_documents.value(documentId);
+        if (!d || page < 0 || page >= d->thumbnails.size())
+            return QImage();
+        data = d->thumbnails.at(page); // implicitly shared
+    }
+    return (data.isEmpty()) ? QImage() : QImage::fromData(data);
+}
+
+bool ThumbnailStore::contains(int documentId, int page) const
+{
+    QMutexLocker locker(&m_mutex);
+    const QSharedPointer<Document> d = m_documents.value(documentId);
+    return d && page >= 0 && page < d->thumbnails.size() && !d->thumbnails.at(page).isEmpty();
+}
+
+QString ThumbnailStore::directory() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_directory;
+}
+
+void ThumbnailStore::setDirectory(const QString &path)
+{
+    QMutexLocker locker(&m_mutex);
+    m_directory = path;
+}
+
+ThumbnailImageProvider::ThumbnailImageProvider(ThumbnailStore &store)
+    : QQuickImageProvider(QQuickImageProvider::Image, QQmlImageProviderBase::ForceAsynchronousImageLoading)
+    , m_store(store)
+{
+}
+
+QImage ThumbnailImageProvider::requestImage(const QString &id, QSize *size, const QSize &requestedSize)
+{
+    const QStringList parts = id.split(QLatin1Char('/'));
+    QImage image;
+    if (parts.size() >= 2)
+        image = m_store.thumbnail(parts.at(0).toInt(), parts.at(1).toInt());
+    if (!image.isNull() && requestedSize.width() > 0 && requestedSize.height() > 0)
+        image = image.scaled(requestedSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    else if (!image.isNull() && requestedSize.width() > 0)
+        image = image.scaledToWidth(requestedSize.width(), Qt::SmoothTransformation);
+    else if (!image.isNull() && requestedSize.height() > 0)
+        image = image.scaledToHeight(requestedSize.height(), Qt::SmoothTransformation);
+    if (size)
+        *size = image.size();
+    return image;
+}
@@ -0,0 +1,90 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef THUMBNAILSTORE_H
+#define THUMBNAILSTORE_H
+
+#include <QObject>
+#include <QQuickImageProvider>
+#include <QThreadPool>
+#include <QMutex>
+#include <QHash>
+#include <QVector>
+#include <QSizeF>
+#include <QSharedPointer>
+#include <QImage>
+
+class PdfManager;
+
+// Small thumbnails of every page of the open documents, for the minimap and
+// the page overview.
+// Thumbnails are generated once a document is ready, one page at a time at
+// Speculative priority in the RenderScheduler, so that they never delay the
+// renders of the pages being read. They are kept JPEG compressed in memory (a few
+// KB per page) and persisted per document, under the same fileName +
+// bytesCount key used for the per-document settings, so that they are
+// generated only once.
+class ThumbnailStore : public QObject
+{
+    Q_OBJECT
+public:
+    // Thumbnails are this wide, and at most twice as tall
+    static const int Width = 128;
+
+    ThumbnailStore(QObject *parent = nullptr);
+    ~ThumbnailStore() override;
+
+    // GUI thread
+    void openDocument(int documentId, const QString &documentKey,
+                      const QVector<QSizeF> &pageSizes, PdfManager &manager);
+    void closeDocument(int documentId);
+    // Blocks until the jobs of the closed documents have stopped
+    void waitForDone();
+
+    // Thread safe. Null until generated
+    QImage thumbnail(int documentId, int page) const;
+    bool contains(int documentId, int page) const;
+
+    QString directory() const;
+    void setDirectory(const QString &path);
+
+signals:
+    // Emitted from the generating thread
+    void thumbnailReady(int documentId, int page);
+
+private:
+    struct Document;
+    friend class ThumbnailJob;
+
+    mutable QMutex m_mutex;
+    QHash<int, QSharedPointer<Document>> m_documents;
+    QString m_directory;
+    QThreadPool m_pool;
+};
+
+// Serves ThumbnailStore through image://pdfthumbs/<documentId>/<page>.
+// Further path components are ignored, e.g. to force a reload once the
+// thumbnail becomes available.
+class ThumbnailImageProvider : public QQuickImageProvider
+{
+public:
+    ThumbnailImageProvider(ThumbnailStore &store);
+
+    QImage requestImage(const QString &id, QSize *size, const QSize &requestedSize) override;
+
+private:
+    ThumbnailStore &m_store;
+};
+
+#endif // THUMBNAILSTORE_H
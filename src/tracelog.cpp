@@ -0,0 +1,140 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#include "tracelog.h"
+#include <QCoreApplication>
+#include <QThread>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QDebug>
+
+bool TraceLog::s_enabled = !qEnvironmentVariableIsEmpty("QDF_TRACE");
+
+namespace {
+const int kFlushThreshold = 4096; // events
+
+void closeTraceLog()
+{
+    TraceLog::instance().close();
+}
+} // namespace
+
+TraceLog &TraceLog::instance()
+{
+    static TraceLog log;
+    return log;
+}
+
+TraceLog::TraceLog()
+{
+    m_clock.start();
+    if (!s_enabled)
+        return;
+    m_file.setFileName(QString::fromLocal8Bit(qgetenv("QDF_TRACE")));
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "TraceLog: cannot write" << m_file.fileName();
+        m_closed = true;
+        return;
+    }
+    // A trace without the closing bracket, e.g. after a crash, still loads
+    m_file.write("[\n");
+    qAddPostRoutine(closeTraceLog);
+}
+
+void TraceLog::begin(const char *category, const char *name, const QString &detail)
+{
+    const int tid = currentThreadId();
+    append({ category, name, 'B', tid, m_clock.nsecsElapsed(), detail });
+}
+
+void TraceLog::end(const char *category, const char *name)
+{
+    const int tid = currentThreadId();
+    append({ category, name, 'E', tid, m_clock.nsecsElapsed(), QString() });
+}
+
+// Small sequential ids, more readable than native handles. The first event
+// of a thread also records its name.
+int TraceLog::currentThreadId()
+{
+    static thread_local int tid = -1;
+    if (tid >= 0)
+        return tid;
+    QThread *thread = QThread::currentThread();
+    QString name = thread->objectName();
+    if (name.isEmpty())
+        name = (qApp && thread == qApp->thread()) ? QStringLiteral("GUI")
+                                          : QLatin1String(thread->metaObject()->className());
+    {
+        QMutexLocker locker(&m_mutex);
+        tid = m_threadCount++;
+    }
+    append({ "__metadata", "thread_name", 'M', tid, 0, name });
+    return tid;
+}
+
+void TraceLog::append(Event &&event)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_closed)
+        return;
+    m_events.append(std::move(event));
+    if (m_events.size() >= kFlushThreshold)
+        writeEvents();
+}
+
+void TraceLog::flush()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_closed)
+        writeEvents();
+}
+
+void TraceLog::close()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_closed)
+        return;
+    writeEvents();
+    m_file.write("\n]\n");
+    m_file.close();
+    m_closed = true;
+}
+
+// Called with m_mutex held
+void TraceLog::writeEvents()
+{
+    const qint64 pid = QCoreApplication::applicationPid();
+    for (const Event &e: qAsConst(m_events)) {
+        QJsonObject o {
+            { QStringLiteral("name"), QLatin1String(e.name) },
+            { QStringLiteral("cat"), QLatin1String(e.category) },
+            { QStringLiteral("ph"), QString(QLatin1Char(e.phase)) },
+            { QStringLiteral("ts"), e.nsecs / 1000.0 }, // microseconds
+            { QStringLiteral("pid"), pid },
+            { QStringLiteral("tid"), e.tid }
+        };
+        if (e.phase == 'M')
+            o.insert(QStringLiteral("args"), QJsonObject { { QStringLiteral("name"), e.detail } });
+        else if (!e.detail.isEmpty())
+            o.insert(QStringLiteral("args"), QJsonObject { { QStringLiteral("detail"), e.detail } });
+        if (!m_first)
+            m_file.write(",\n");
+        m_first = false;
+        m_file.write(QJsonDocument(o).toJson(QJsonDocument::Compact));
+    }
+    m_events.clear();
+    m_file.flush();
+}
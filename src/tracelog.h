@@ -0,0 +1,93 @@
+/*
+Copyright (C) 2023- Paolo Angelelli <paoletto@gmail.com>
+
+This work is licensed under the terms of the Creative Commons Attribution-NonCommercial-ShareAlike 4.0 International License.
+To view a copy of this license, visit https://creativecommons.org/licenses/by-nc-sa/4.0/ or send a letter to Creative Commons, PO Box 1866, Mountain View, CA 94042, USA.
+
+In addition to the above,
+- The use of this work for training artificial intelligence is prohibited for both commercial and non-commercial use.
+- Any and all donation options in derivative work must be the same as in the original work.
+- All use of this work outside of the above terms must be explicitly agreed upon in advance with the exclusive copyright owner(s).
+- Any derivative work must retain the above copyright and acknowledge that any and all use of the derivative work outside the above terms
+  must be explicitly agreed upon in advance with the exclusive copyright owner(s) of the original work.
+*/
+
+#ifndef TRACELOG_H
+#define TRACELOG_H
+
+#include <QString>
+#include <QVector>
+#include <QMutex>
+#include <QFile>
+#include <QElapsedTimer>
+
+// Opt-in recorder of begin/end events in the Chrome trace-event JSON format,
+// loadable in chrome://tracing or ui.perfetto.dev.
+// Enabled by setting QDF_TRACE to the path of the file to write. Events are
+// buffered and written in batches, and the file is closed when the
+// application quits. Each thread shows up as a track named after it.
+class TraceLog
+{
+public:
+    static bool isEnabled()
+    {
+        return s_enabled;
+    }
+    static TraceLog &instance();
+
+    void begin(const char *category, const char *name, const QString &detail = QString());
+    void end(const char *category, const char *name);
+    void flush();
+    void close();
+
+private:
+    TraceLog();
+
+    struct Event
+    {
+        const char *category;
+        const char *name;
+        char phase;
+        int tid;
+        qint64 nsecs;
+        QString detail;
+    };
+
+    void append(Event &&event);
+    int currentThreadId();
+    void writeEvents();
+
+    static bool s_enabled;
+
+    QMutex m_mutex;
+    QVector<Event> m_events;
+    QFile m_file;
+    QElapsedTimer m_clock;
+    int m_threadCount = 0;
+    bool m_first = true;
+    bool m_closed = false;
+};
+
+// Emits a begin event on construction and the matching end on destruction
+class TraceScope
+{
+public:
+    TraceScope(const char *category, const char *name, const QString &detail = QString())
+        : m_category(category), m_name(name)
+    {
+        if (TraceLog::isEnabled())
+            TraceLog::instance().begin(m_category, m_name, detail);
+    }
+    ~TraceScope()
+    {
+        if (TraceLog::isEnabled())
+            TraceLog::instance().end(m_category, m_name);
+    }
+
+private:
+    Q_DISABLE_COPY(TraceScope)
+    const char *m_category;
+    const char *m_name;
+};
+
+#endif // TRACELOG_H